@@ -0,0 +1,261 @@
+/*
+ * Action processing: layers, tap keys and macros
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "bsp/board.h"
+
+#include "action.h"
+#include "cycles.h"
+
+
+// bit n: layer n is active, layer 0 is always active
+uint32_t layer_state = 1;
+
+// action resolved at press is used at release so that layer change while
+// pressing doesn't leave stuck key
+static uint16_t pressed_action[256];
+
+// tap key waiting for tap/hold decision
+static struct {
+    uint16_t action;
+    uint32_t time;
+    uint8_t key;
+    bool active;    // pressed and not released yet
+    bool held;      // decided as hold
+} tapping;
+
+// macro being played
+static const uint8_t *macro_p = NULL;
+static uint32_t macro_wait_ms = 0;
+static uint32_t macro_time = 0;
+
+static action_stats_t action_stats;
+
+
+void layer_on(uint8_t layer)
+{
+    if (layer < keymap_layers) layer_state |= ((uint32_t) 1 << layer);
+}
+
+void layer_off(uint8_t layer)
+{
+    if (layer != 0) layer_state &= ~((uint32_t) 1 << layer);
+}
+
+void layer_invert(uint8_t layer)
+{
+    if (layer != 0 && layer < keymap_layers) layer_state ^= ((uint32_t) 1 << layer);
+}
+
+uint32_t layer_held(void)
+{
+    uint32_t held = 0;
+    for (uint16_t key = 0; key < 256; key++) {
+        uint16_t action = pressed_action[key];
+        if ((action >> 12) == 0x2) {
+            held |= (uint32_t) 1 << ((action >> 8) & 0xF);
+        } else if ((action & 0xFF00) == 0xF000) {
+            held |= (uint32_t) 1 << (action & 0x1F);
+        }
+    }
+    return held & ~(uint32_t) 1;
+}
+
+// O(layers): first non-transparent action from highest active layer
+static uint16_t action_for_key(uint8_t key)
+{
+    for (int8_t i = (int8_t) (keymap_layers - 1); i >= 0; i--) {
+        if (!(layer_state & ((uint32_t) 1 << i))) continue;
+        uint16_t action = keymaps[i][key];
+        if (action != ACTION_TRNS) return action;
+    }
+    return ACTION_TRNS;
+}
+
+static void register_mods(uint8_t mods, bool make)
+{
+    for (uint8_t i = 0; i < 4; i++) {
+        if (mods & (1 << i)) register_code((uint16_t) (0xE0 + i), make);
+    }
+}
+
+static void tap_hold(uint16_t action, bool on)
+{
+    uint8_t arg = (uint8_t) ((action >> 8) & 0xF);
+    if ((action >> 12) == 0x2) {
+        if (on) layer_on(arg); else layer_off(arg);
+    } else {
+        register_mods(arg, on);
+    }
+}
+
+static void tapping_decide_hold(void)
+{
+    if (!tapping.active || tapping.held) return;
+    tapping.held = true;
+    tap_hold(tapping.action, true);
+}
+
+static void macro_play(uint8_t id)
+{
+    if (id >= macro_count) return;
+    macro_p = macros[id];
+    macro_wait_ms = 0;
+}
+
+static void process_action(uint8_t key, uint16_t action, bool pressed)
+{
+    uint8_t arg = (uint8_t) (action & 0xFF);
+    switch (action >> 12) {
+        case 0x2:   // Layer Tap
+        case 0x3:   // Mods Tap
+            if (pressed) {
+                tapping.action = action;
+                tapping.time = board_millis();
+                tapping.key = key;
+                tapping.active = true;
+                tapping.held = false;
+            } else if (tapping.active && tapping.key == key) {
+                tapping.active = false;
+                if (tapping.held) {
+                    tap_hold(action, false);
+                } else {
+                    register_code(arg, true);
+                    register_code(arg, false);
+                }
+            } else {
+                // replaced by other tap key after decided as hold
+                tap_hold(action, false);
+            }
+            break;
+        case 0xF:
+            switch ((action >> 8) & 0xF) {
+                case 0x0:
+                    if (pressed) layer_on(arg); else layer_off(arg);
+                    break;
+                case 0x1:
+                    if (pressed) layer_invert(arg);
+                    break;
+                case 0x2:
+                    if (pressed) macro_play(arg);
+                    break;
+                default:
+                    break;
+            }
+            break;
+        default:
+            register_code(action, pressed);
+            break;
+    }
+}
+
+void action_exec(uint8_t key, bool pressed)
+{
+    uint32_t start = cycles_read();
+
+    uint16_t action;
+    if (pressed) {
+        // typematic repeat: report is not changed
+        if (pressed_action[key] != ACTION_TRNS) return;
+
+        // other key press decides hold of pending tap key
+        if (tapping.active) {
+            tapping_decide_hold();
+        }
+        action = action_for_key(key);
+        pressed_action[key] = action;
+    } else {
+        action = pressed_action[key];
+        pressed_action[key] = ACTION_TRNS;
+    }
+
+    if (action != ACTION_TRNS && action != ACTION_NO) {
+        process_action(key, action, pressed);
+    }
+
+    uint32_t cycles = cycles_since(start);
+    action_stats.events++;
+    action_stats.total_cycles += cycles;
+    if (cycles > action_stats.max_cycles) action_stats.max_cycles = cycles;
+    uint8_t n = 0;
+    for (uint32_t c = cycles >> 6; c && n < ACTION_HIST_SIZE - 1; c >>= 1) n++;
+    action_stats.hist[n]++;
+}
+
+void action_task(void)
+{
+    if (tapping.active && !tapping.held && board_millis() - tapping.time >= TAPPING_TERM) {
+        tapping_decide_hold();
+    }
+
+    if (!macro_p) return;
+    if (macro_wait_ms) {
+        if (board_millis() - macro_time < macro_wait_ms) return;
+        macro_wait_ms = 0;
+    }
+    // one report per USB frame
+    if (!keyboard_queue_empty()) return;
+
+    switch (*macro_p++) {
+        case 0x01:
+            register_code(*macro_p++, true);
+            break;
+        case 0x02:
+            register_code(*macro_p++, false);
+            break;
+        case 0x03:
+            macro_wait_ms = *macro_p++;
+            macro_time = board_millis();
+            break;
+        case MACRO_END:
+        default:
+            macro_p = NULL;
+            break;
+    }
+}
+
+// release everything, e.g. when keyboard is lost
+void action_clear(void)
+{
+    tapping.active = false;
+    macro_p = NULL;
+    for (uint16_t key = 0; key < 256; key++) {
+        if (pressed_action[key] != ACTION_TRNS) {
+            action_exec((uint8_t) key, false);
+        }
+    }
+    layer_state = 1;
+}
+
+void action_print_stats(void)
+{
+    uint32_t mhz = clock_get_hz(clk_sys) / 1000000;
+    printf("layer_state:%08lX events:%lu max:%lucyc(%luns) avg:%lucyc\n",
+            (unsigned long) layer_state,
+            (unsigned long) action_stats.events,
+            (unsigned long) action_stats.max_cycles,
+            (unsigned long) (action_stats.max_cycles * 1000 / mhz),
+            (unsigned long) (action_stats.events ? action_stats.total_cycles / action_stats.events : 0));
+    printf("hist:");
+    for (uint8_t i = 0; i < ACTION_HIST_SIZE; i++) {
+        printf(" %lu", (unsigned long) action_stats.hist[i]);
+    }
+    printf("\n");
+}
+
+const action_stats_t *action_get_stats(void)
+{
+    return &action_stats;
+}
+
+void action_clear_stats(void)
+{
+    memset(&action_stats, 0, sizeof(action_stats));
+}
@@ -0,0 +1,84 @@
+#ifndef ACTION_H
+#define ACTION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Action code: uint16_t value stored in keymap layers
+ *
+ *   0x0000                 transparent(falls through to lower layer), no action on layer 0
+ *   0x0nnn/0x7nnn          Keyboard usage
+ *   0xCnnn                 Consumer usage
+ *   0x1nnn                 Generic Desktop(System Control) usage
+ *   0x2LKK                 Layer Tap:  hold -> momentary layer L, tap -> Keyboard usage KK
+ *   0x3MKK                 Mods Tap:   hold -> mods M(bit0:Ctrl 1:Shift 2:Alt 3:GUI), tap -> Keyboard usage KK
+ *   0xF0LL                 momentary layer LL
+ *   0xF1LL                 toggle layer LL
+ *   0xF2NN                 play macro NN
+ *   0xFFFF                 no action(blocks lower layers)
+ */
+#define ACTION_TRNS                     0x0000
+#define ACTION_NO                       0xFFFF
+#define ACTION_LAYER_TAP_KEY(layer, key)    (uint16_t) (0x2000 | ((layer) & 0xF) << 8 | ((key) & 0xFF))
+#define ACTION_MODS_TAP_KEY(mods, key)      (uint16_t) (0x3000 | ((mods) & 0xF) << 8 | ((key) & 0xFF))
+#define ACTION_LAYER_MOMENTARY(layer)       (uint16_t) (0xF000 | ((layer) & 0xFF))
+#define ACTION_LAYER_TOGGLE(layer)          (uint16_t) (0xF100 | ((layer) & 0xFF))
+#define ACTION_MACRO(id)                    (uint16_t) (0xF200 | ((id) & 0xFF))
+
+#define MOD_CTRL    0x1
+#define MOD_SHIFT   0x2
+#define MOD_ALT     0x4
+#define MOD_GUI     0x8
+
+// hold of tap key is determined after this time or when other key is pressed
+#define TAPPING_TERM    200
+
+/*
+ * Macro: byte sequence of steps terminated by MACRO_END
+ *
+ * Each of DOWN/UP makes one keyboard report, and one step is played
+ * per USB frame through the keyboard report queue.
+ */
+#define MACRO_END           0x00
+#define MACRO_DOWN(key)     0x01, (key)
+#define MACRO_UP(key)       0x02, (key)
+#define MACRO_TYPE(key)     MACRO_DOWN(key), MACRO_UP(key)
+#define MACRO_WAIT(ms)      0x03, (ms)
+
+// keymap.c
+extern uint16_t * const keymaps[];
+extern const uint8_t keymap_layers;
+extern const uint8_t * const macros[];
+extern const uint8_t macro_count;
+
+// Processing time of action_exec: bucket n counts events taking less than
+// 64 << n cycles, the last one counts the rest
+#define ACTION_HIST_SIZE    12
+typedef struct {
+    uint32_t events;
+    uint32_t max_cycles;
+    uint32_t total_cycles;
+    uint32_t hist[ACTION_HIST_SIZE];
+} action_stats_t;
+
+// key: position in keymap, Code Set 2 code(E0-prefixed: code | 0x80)
+void action_exec(uint8_t key, bool pressed);
+void action_task(void);
+void action_clear(void);
+void action_print_stats(void);
+const action_stats_t *action_get_stats(void);
+void action_clear_stats(void);
+
+extern uint32_t layer_state;
+void layer_on(uint8_t layer);
+void layer_off(uint8_t layer);
+void layer_invert(uint8_t layer);
+// layers on while their keys are held: momentary and Layer Tap
+uint32_t layer_held(void);
+
+// ps2.c
+void register_code(uint16_t code, bool make);
+bool keyboard_queue_empty(void);
+
+#endif
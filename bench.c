@@ -0,0 +1,178 @@
+/*
+ * Self-benchmark with synthetic load
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stdio.h>
+#include "pico/stdlib.h"
+
+#include "bench.h"
+#include "ps2.h"
+#include "capture.h"
+
+
+// Patterns leave no key pressed at their end
+static const uint8_t pattern_storm[] = {
+    // 8 keys pressed at once and released
+    0x1C, 0x32, 0x21, 0x23, 0x24, 0x2B, 0x34, 0x33,
+    0xF0, 0x1C, 0xF0, 0x32, 0xF0, 0x21, 0xF0, 0x23,
+    0xF0, 0x24, 0xF0, 0x2B, 0xF0, 0x34, 0xF0, 0x33,
+};
+
+static const uint8_t pattern_e0e1[] = {
+    // Up
+    0xE0, 0x75, 0xE0, 0xF0, 0x75,
+    // PrintScreen with fake shift
+    0xE0, 0x12, 0xE0, 0x7C, 0xE0, 0xF0, 0x7C, 0xE0, 0xF0, 0x12,
+    // Pause
+    0xE1, 0x14, 0x77, 0xE1, 0xF0, 0x14, 0xF0, 0x77,
+    // Keypad /
+    0xE0, 0x4A, 0xE0, 0xF0, 0x4A,
+};
+
+static const uint8_t pattern_media[] = {
+    // Mute, Volume Up, Volume Down and Play/Pause overlapped
+    0xE0, 0x23, 0xE0, 0x32, 0xE0, 0x21, 0xE0, 0x34,
+    0xE0, 0xF0, 0x23, 0xE0, 0xF0, 0x32, 0xE0, 0xF0, 0x21, 0xE0, 0xF0, 0x34,
+};
+
+static const struct {
+    const char *name;
+    const uint8_t *data;
+    uint16_t len;
+} patterns[] = {
+    { "storm", pattern_storm, sizeof(pattern_storm) },
+    { "e0e1",  pattern_e0e1,  sizeof(pattern_e0e1) },
+    { "media", pattern_media, sizeof(pattern_media) },
+};
+#define PATTERN_COUNT   (sizeof(patterns) / sizeof(patterns[0]))
+
+static const uint32_t rates[] = BENCH_RATES;
+#define RATE_COUNT      (sizeof(rates) / sizeof(rates[0]))
+
+// bench keyboard: no LED command to keyboard not connected
+static const keyboard_profile_t bench_profile = { 0x0000, PROFILE_NO_LED, "benchmark" };
+
+static struct {
+    bool active;
+    bool capture;
+    uint8_t rate;       // index of rates[]
+    uint8_t pattern;
+    uint16_t index;     // in pattern
+    uint32_t start;     // us
+    uint32_t bytes;
+    uint32_t events;    // at start
+    uint32_t loop_time;
+    uint32_t loop_max;
+    bool draining;      // pattern completed, waiting for decoder
+} bench;
+
+
+static void bench_pattern_start(void)
+{
+    hid_clear_queue_stats();
+    bench.index = 0;
+    bench.bytes = 0;
+    bench.draining = false;
+    bench.events = ps2_keyboard(0)->stats.events;
+    bench.loop_max = 0;
+    bench.start = bench.loop_time = time_us_32();
+}
+
+static void bench_pattern_finish(void)
+{
+    uint32_t us = time_us_32() - bench.start;
+    uint32_t events = ps2_keyboard(0)->stats.events - bench.events;
+    const hid_queue_stats_t *q = hid_get_queue_stats();
+    printf("\nbench: %s rate=%lu bytes=%lu events/s=%lu loop_max=%luus queue_max=%u overwrites=%lu\n",
+            patterns[bench.pattern].name,
+            (unsigned long) rates[bench.rate],
+            (unsigned long) bench.bytes,
+            (unsigned long) ((uint64_t) events * 1000000 / us),
+            (unsigned long) bench.loop_max,
+            q->max_depth,
+            (unsigned long) q->overwrites);
+}
+
+void bench_init(void)
+{
+    gpio_init(BENCH_PIN);
+    gpio_set_dir(BENCH_PIN, GPIO_IN);
+    gpio_pull_up(BENCH_PIN);
+    busy_wait_us_32(10);
+    if (!gpio_get(BENCH_PIN)) bench_start();
+}
+
+void bench_start(void)
+{
+    if (bench.active) return;
+
+    keyboard_t *kbd = ps2_keyboard(0);
+    kbd->id = bench_profile.id;
+    kbd->profile = &bench_profile;
+    kbd->code_set = 2;
+    kbd->decode_state = 0;
+
+    // don't record bench itself
+    bench.capture = capture_enabled;
+    capture_enabled = false;
+    hid_sink(true);
+    bench.active = true;
+    bench.pattern = 0;
+    bench_pattern_start();
+}
+
+void bench_next_rate(void)
+{
+    bench.rate = (uint8_t) ((bench.rate + 1) % RATE_COUNT);
+    printf("bench rate:%lu\n", (unsigned long) rates[bench.rate]);
+}
+
+static void bench_finish(void)
+{
+    // detect keyboard again
+    ps2_redetect(ps2_keyboard(0));
+    hid_sink(false);
+    capture_enabled = bench.capture;
+    bench.active = false;
+}
+
+void bench_task(void)
+{
+    if (!bench.active) return;
+
+    // main loop iteration time
+    uint32_t now = time_us_32();
+    if (now - bench.loop_time > bench.loop_max) bench.loop_max = now - bench.loop_time;
+    bench.loop_time = now;
+
+    ps2_port_t *port = &ps2_keyboard(0)->port;
+    if (bench.draining) {
+        if (!ringbuf_is_empty(&port->rbuf)) return;
+        bench_pattern_finish();
+        if (++bench.pattern < PATTERN_COUNT) {
+            bench_pattern_start();
+        } else {
+            bench_finish();
+        }
+        return;
+    }
+
+    // inject bytes due by now
+    uint32_t elapsed = now - bench.start;
+    uint32_t target = rates[bench.rate] ? (uint32_t) ((uint64_t) elapsed * rates[bench.rate] / 1000000) : UINT32_MAX;
+    const uint8_t *data = patterns[bench.pattern].data;
+    uint16_t len = patterns[bench.pattern].len;
+    while (bench.bytes < target) {
+        // stop at end of pattern so that no key is left pressed
+        if (bench.index == 0 && elapsed >= BENCH_DURATION_MS * 1000) {
+            bench.draining = true;
+            return;
+        }
+        if (!ps2_port_inject(port, &data[bench.index], 1)) break;
+        bench.index = (uint16_t) ((bench.index + 1) % len);
+        bench.bytes++;
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Self-benchmark: synthetic Code Set 2 streams injected into receive buffer
+ * of the first keyboard port, no keyboard is needed
+ *
+ * Each pattern runs for BENCH_DURATION_MS at the selected byte rate and
+ * the result is printed on CDC:
+ *
+ *   bench: <pattern> rate=<bytes/s> bytes=<n> events/s=<n> loop_max=<us> queue_max=<n> overwrites=<n>
+ *
+ * Reports are not sent to host. They are dropped one per millisecond to
+ * emulate 1ms polling so that report queues behave as in real use.
+ * Bench starts at power-on when BENCH_PIN is tied to GND.
+ */
+#define BENCH_DURATION_MS   2000
+#define BENCH_PIN           15
+
+// 0: as fast as receive buffer accepts
+#define BENCH_RATES         { 1000, 10000, 100000, 0 }
+
+void bench_init(void);
+void bench_start(void);
+void bench_next_rate(void);
+void bench_task(void);
+
+#endif
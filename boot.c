@@ -0,0 +1,45 @@
+/*
+ * Startup profiling
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stdio.h>
+#include "pico/stdlib.h"
+
+#include "boot.h"
+
+
+static const char * const stage_names[BOOT_STAGE_COUNT] = {
+    [BOOT_MAIN]             = "main",
+    [BOOT_BOARD]            = "board",
+    [BOOT_PS2]              = "ps2",
+    [BOOT_USB]              = "usb",
+    [BOOT_STDIO]            = "stdio",
+    [BOOT_MOUNTED]          = "mounted",
+    [BOOT_KEYBOARD_BAT]     = "keyboard_bat",
+    [BOOT_KEYBOARD_READY]   = "keyboard_ready",
+    [BOOT_FIRST_REPORT]     = "first_report",
+};
+
+// 0: not reached yet
+static uint32_t stage_time[BOOT_STAGE_COUNT];
+
+void boot_mark(uint8_t stage)
+{
+    if (stage >= BOOT_STAGE_COUNT || stage_time[stage]) return;
+    stage_time[stage] = time_us_32();
+    if (!stage_time[stage]) stage_time[stage] = 1;
+}
+
+void boot_print(void)
+{
+    for (uint8_t i = 0; i < BOOT_STAGE_COUNT; i++) {
+        if (stage_time[i]) {
+            printf("%-15s %8luus\n", stage_names[i], (unsigned long) stage_time[i]);
+        } else {
+            printf("%-15s        -\n", stage_names[i]);
+        }
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdint.h>
+
+/*
+ * Startup profiling: time of each stage from power-on in microseconds
+ *
+ * Timer starts at reset, so times include boot ROM and flash second stage.
+ * Each stage is recorded only the first time.
+ */
+enum {
+    BOOT_MAIN,              // main() entered
+    BOOT_BOARD,             // board_init() done
+    BOOT_PS2,               // PS/2 ports receiving
+    BOOT_USB,               // tud_init() done
+    BOOT_STDIO,             // stdio_init_all() done
+    BOOT_MOUNTED,           // USB configured by host
+    BOOT_KEYBOARD_BAT,      // BAT code from keyboard
+    BOOT_KEYBOARD_READY,    // keyboard identified and set up
+    BOOT_FIRST_REPORT,      // first keyboard report accepted by host
+    BOOT_STAGE_COUNT
+};
+
+void boot_mark(uint8_t stage);
+void boot_print(void);
+
+#endif
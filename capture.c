@@ -0,0 +1,59 @@
+/*
+ * Capture of PS/2 traffic
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stdio.h>
+#include "pico/stdlib.h"
+
+#include "capture.h"
+
+
+bool capture_enabled = true;
+
+static capture_t entries[CAPTURE_SIZE];
+static uint16_t head = 0;
+static uint16_t count = 0;
+
+void capture_record(uint8_t pin, uint8_t type, uint8_t data)
+{
+    if (!capture_enabled) return;
+
+    capture_t *e = &entries[head];
+    e->time = time_us_32();
+    e->pin = pin;
+    e->type = type;
+    e->data = data;
+    head = (head + 1) & (CAPTURE_SIZE - 1);
+    if (count < CAPTURE_SIZE) count++;
+}
+
+uint16_t capture_count(void)
+{
+    return count;
+}
+
+const capture_t *capture_get(uint16_t i)
+{
+    if (i >= count) return NULL;
+    return &entries[(head - count + i) & (CAPTURE_SIZE - 1)];
+}
+
+void capture_clear(void)
+{
+    head = 0;
+    count = 0;
+}
+
+// one entry per line: time(us) pin type data
+void capture_dump(void)
+{
+    printf("\ncapture:%u\n", count);
+    for (uint16_t i = 0; i < count; i++) {
+        const capture_t *e = capture_get(i);
+        printf("%lu %u %c %02X\n", (unsigned long) e->time, e->pin, e->type, e->data);
+    }
+    printf("end\n");
+}
@@ -0,0 +1,38 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Capture of PS/2 traffic: RAM ring of timestamped bytes
+ *
+ * Bytes passed to decoder, sent commands, their responses and line errors
+ * are recorded in main thread. Oldest entry is overwritten when full.
+ */
+#define CAPTURE_SIZE    1024    // 2^n entries
+
+enum {
+    CAPTURE_RECV = 'R',         // received and passed to decoder
+    CAPTURE_SEND = 'S',         // command sent
+    CAPTURE_RESPONSE = 'A',     // response to command
+    CAPTURE_ERROR = 'E',        // line error, data is error code
+};
+
+typedef struct {
+    uint32_t time;      // us
+    uint8_t pin;        // clock pin of port
+    uint8_t type;
+    uint8_t data;
+    uint8_t reserved;
+} capture_t;
+
+extern bool capture_enabled;
+
+void capture_record(uint8_t pin, uint8_t type, uint8_t data);
+uint16_t capture_count(void);
+const capture_t *capture_get(uint16_t i);   // 0: oldest
+void capture_clear(void);
+void capture_dump(void);
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Key chatter filter
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+#include "bsp/board.h"
+
+#include "chatter.h"
+
+
+uint8_t chatter_window_ms = CHATTER_WINDOW_MS;
+
+static uint16_t last_ms[256];       // last accepted transition
+static uint8_t state[32];           // reported state
+static uint8_t raw[32];             // actual state from keyboard
+static uint8_t pending[32];         // suppressed and not settled yet
+static uint8_t pending_count = 0;
+static chatter_stats_t chatter_stats;
+
+static bool bit_get(const uint8_t *bits, uint8_t key)
+{
+    return bits[key >> 3] & (1 << (key & 7));
+}
+
+static void bit_set(uint8_t *bits, uint8_t key, bool on)
+{
+    if (on) bits[key >> 3] |= (uint8_t) (1 << (key & 7));
+    else bits[key >> 3] &= (uint8_t) ~(1 << (key & 7));
+}
+
+static bool in_window(uint8_t key)
+{
+    return (uint16_t) ((uint16_t) board_millis() - last_ms[key]) < chatter_window_ms;
+}
+
+// true when transition should be passed to keymap
+bool chatter_pass(uint8_t key, bool make)
+{
+    bit_set(raw, key, make);
+    if (!chatter_window_ms) {
+        bit_set(state, key, make);
+        return true;
+    }
+
+    if (in_window(key)) {
+        chatter_stats.suppressed++;
+        if (chatter_stats.count[key] < 0xFF) chatter_stats.count[key]++;
+        if (!bit_get(pending, key)) {
+            bit_set(pending, key, true);
+            pending_count++;
+        }
+        return false;
+    }
+    if (bit_get(state, key) == make) return false;  // settled already
+
+    bit_set(state, key, make);
+    last_ms[key] = (uint16_t) board_millis();
+    return true;
+}
+
+// Transition to settle key state after chatter, one at a time
+bool chatter_settle(uint8_t *key, bool *make)
+{
+    if (!pending_count) return false;
+
+    for (uint16_t k = 0; k < 256; k++) {
+        if (!bit_get(pending, (uint8_t) k)) continue;
+        if (chatter_window_ms && in_window((uint8_t) k)) continue;
+
+        bit_set(pending, (uint8_t) k, false);
+        pending_count--;
+        bool r = bit_get(raw, (uint8_t) k);
+        if (bit_get(state, (uint8_t) k) == r) continue;
+
+        bit_set(state, (uint8_t) k, r);
+        last_ms[k] = (uint16_t) board_millis();
+        *key = (uint8_t) k;
+        *make = r;
+        return true;
+    }
+    return false;
+}
+
+const chatter_stats_t *chatter_get_stats(void)
+{
+    return &chatter_stats;
+}
+
+void chatter_print(void)
+{
+    printf("chatter window:%ums suppressed:%lu\n", chatter_window_ms, (unsigned long) chatter_stats.suppressed);
+    for (uint16_t k = 0; k < 256; k++) {
+        if (chatter_stats.count[k]) printf(" %02X:%u", k, chatter_stats.count[k]);
+    }
+    printf("\n");
+}
+
+void chatter_clear(void)
+{
+    memset(&chatter_stats, 0, sizeof(chatter_stats));
+}
@@ -0,0 +1,35 @@
+#ifndef CHATTER_H
+#define CHATTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Key chatter filter for worn keyboards
+ *
+ * Transition of a key position within the window after its last accepted
+ * transition is suppressed; the first edge is never delayed. When the key
+ * ends up in other state than reported after chatter, the state is settled
+ * at the end of the window so that no key is left stuck.
+ *
+ * Applied to merged key position events between scan code decoder and
+ * keymap. Times are kept in 16-bit milliseconds.
+ */
+#ifndef CHATTER_WINDOW_MS
+#define CHATTER_WINDOW_MS   0       // 0: disabled
+#endif
+
+typedef struct {
+    uint32_t suppressed;
+    uint8_t count[256];     // suppressed per key position, saturated
+} chatter_stats_t;
+
+extern uint8_t chatter_window_ms;
+
+bool chatter_pass(uint8_t key, bool make);
+bool chatter_settle(uint8_t *key, bool *make);
+const chatter_stats_t *chatter_get_stats(void);
+void chatter_print(void);
+void chatter_clear(void);
+
+#endif
@@ -0,0 +1,129 @@
+/*
+ * Debug console on CDC
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stdio.h>
+#include "pico/stdlib.h"
+
+#include "command.h"
+#include "action.h"
+#include "ps2.h"
+#include "capture.h"
+#include "logic.h"
+#include "bench.h"
+#include "boot.h"
+#include "stage.h"
+#include "sof.h"
+#include "chatter.h"
+#include "masked.h"
+#include "recover.h"
+
+
+static void command_help(void)
+{
+    printf("\n"
+           "h: help\n"
+           "a: action stats\n"
+           "p: keyboard port stats\n"
+           "c: dump capture\n"
+           "x: clear capture\n"
+           "t: toggle capture\n"
+           "r: replay capture(fast)\n"
+           "R: replay capture(timed)\n"
+           "l: logic analyzer on first keyboard port\n"
+           "b: benchmark with synthetic load\n"
+           "B: change benchmark rate\n"
+           "s: startup stage times and watchdog\n"
+           "q: pipeline stage stats\n"
+           "Q: clear pipeline stage stats\n"
+           "f: SOF phase stats\n"
+           "F: clear SOF phase stats\n"
+           "o: toggle SOF aligned reports\n"
+           "k: key chatter stats\n"
+           "K: clear key chatter stats\n"
+           "i: interrupt masked time stats\n"
+           "I: clear interrupt masked time stats\n");
+}
+
+void command_task(void)
+{
+    int c = getchar_timeout_us(0);
+    if (c == PICO_ERROR_TIMEOUT) return;
+
+    // output may block while CDC buffer is full
+    recover_hold(RECOVER_COMMAND_MS);
+
+    switch (c) {
+        case 'h':
+            command_help();
+            break;
+        case 'a':
+            action_print_stats();
+            break;
+        case 'p':
+            ps2_print_stats();
+            break;
+        case 'c':
+            capture_dump();
+            break;
+        case 'x':
+            capture_clear();
+            break;
+        case 't':
+            capture_enabled = !capture_enabled;
+            printf("capture:%s\n", capture_enabled ? "on" : "off");
+            break;
+        case 'r':
+            ps2_replay(false);
+            break;
+        case 'R':
+            ps2_replay(true);
+            break;
+        case 'l':
+            logic_start(ps2_keyboard(0)->port.clock_pin);
+            break;
+        case 'b':
+            bench_start();
+            break;
+        case 'B':
+            bench_next_rate();
+            break;
+        case 's':
+            boot_print();
+            recover_print();
+            break;
+        case 'q':
+            stage_print();
+            break;
+        case 'Q':
+            stage_clear();
+            break;
+        case 'f':
+            sof_print();
+            break;
+        case 'F':
+            sof_clear();
+            break;
+        case 'o':
+            sof_align = !sof_align;
+            printf("sof align:%s\n", sof_align ? "on" : "off");
+            break;
+        case 'k':
+            chatter_print();
+            break;
+        case 'K':
+            chatter_clear();
+            break;
+        case 'i':
+            masked_print();
+            break;
+        case 'I':
+            masked_clear();
+            break;
+        default:
+            break;
+    }
+}
@@ -0,0 +1,7 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+// debug console on CDC: one character command
+void command_task(void);
+
+#endif
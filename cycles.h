@@ -0,0 +1,27 @@
+#ifndef CYCLES_H
+#define CYCLES_H
+
+#include <stdint.h>
+#include "hardware/structs/systick.h"
+
+// Cortex-M0+ has no DWT cycle counter, use SysTick as free-running 24-bit
+// down counter clocked by processor clock instead. It wraps around in
+// about 134ms at 125MHz, which is long enough to measure short code paths.
+#define CYCLES_MASK     0x00FFFFFF
+
+static inline void cycles_init(void)
+{
+    systick_hw->csr = 0;
+    systick_hw->rvr = CYCLES_MASK;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5;  // CLKSOURCE(processor) | ENABLE, no interrupt
+}
+static inline uint32_t cycles_read(void)
+{
+    return systick_hw->cvr;
+}
+static inline uint32_t cycles_since(uint32_t start)
+{
+    return (start - systick_hw->cvr) & CYCLES_MASK;
+}
+#endif
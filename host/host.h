@@ -0,0 +1,26 @@
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/*
+ * Host build: converter core on Linux
+ *
+ * Firmware sources are built unchanged against pico-sdk shim in include/ and
+ * TinyUSB headers. PS/2 keyboard is emulated on the input stream and HID
+ * reports are emitted through /dev/uhid.
+ */
+#define HOST_KEYBOARD_PIN   2       // clock pin of keyboards[0] in ps2.c
+
+// sdk.c: console commands are read from this fd, -1 disables
+extern int host_console_fd;
+
+// ps2_port_host.c: bytes from raw stream, or 'R' entries of capture dump
+// replayed with their timing or back to back(fast)
+void host_port_input(FILE *in, bool capture, bool fast);
+
+// usbd_uhid.c: print reports on stdout instead of creating uhid devices
+void host_usb_dump(bool dump);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef HOST_BSP_BOARD_H
+#define HOST_BSP_BOARD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+void board_init(void);
+uint32_t board_millis(void);
+void board_led_write(bool state);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef HOST_HARDWARE_ADDRESS_MAPPED_H
+#define HOST_HARDWARE_ADDRESS_MAPPED_H
+
+#include <stdint.h>
+#include "hardware/regs/m0plus.h"
+
+typedef volatile uint32_t io_rw_32;
+typedef const volatile uint32_t io_ro_32;
+
+// Private peripheral bus: only NVIC set-pending register, which is in
+// host/sdk.c and never has an interrupt pending
+extern uint32_t host_nvic_ispr;
+#define PPB_BASE    ((uintptr_t) &host_nvic_ispr - M0PLUS_NVIC_ISPR_OFFSET)
+
+#endif
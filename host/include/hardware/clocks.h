@@ -0,0 +1,13 @@
+#ifndef HOST_HARDWARE_CLOCKS_H
+#define HOST_HARDWARE_CLOCKS_H
+
+#include <stdint.h>
+
+// SysTick emulation in host/sdk.c counts at this rate
+#define HOST_CLK_SYS_HZ 125000000
+
+enum clock_index { clk_sys = 5 };
+
+static inline uint32_t clock_get_hz(enum clock_index clk) { (void) clk; return HOST_CLK_SYS_HZ; }
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef HOST_HARDWARE_GPIO_H
+#define HOST_HARDWARE_GPIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// no GPIO on host: inputs read high(pulled up), outputs are ignored
+typedef unsigned int uint;
+
+#define GPIO_IN     false
+#define GPIO_OUT    true
+#define NUM_BANK0_GPIOS 30
+
+static inline void gpio_init(uint gpio) { (void) gpio; }
+static inline void gpio_set_dir(uint gpio, bool out) { (void) gpio; (void) out; }
+static inline void gpio_put(uint gpio, bool value) { (void) gpio; (void) value; }
+static inline bool gpio_get(uint gpio) { (void) gpio; return true; }
+static inline void gpio_pull_up(uint gpio) { (void) gpio; }
+static inline void gpio_set_pulls(uint gpio, bool up, bool down) { (void) gpio; (void) up; (void) down; }
+
+#endif
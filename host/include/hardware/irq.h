@@ -0,0 +1,8 @@
+#ifndef HOST_HARDWARE_IRQ_H
+#define HOST_HARDWARE_IRQ_H
+
+#include "hardware/sync.h"
+
+#define IO_IRQ_BANK0    13
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef HOST_HARDWARE_REGS_M0PLUS_H
+#define HOST_HARDWARE_REGS_M0PLUS_H
+
+#define M0PLUS_NVIC_ISPR_OFFSET     0x0000e200
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef HOST_HARDWARE_STRUCTS_SYSTICK_H
+#define HOST_HARDWARE_STRUCTS_SYSTICK_H
+
+#include <stdint.h>
+
+typedef struct {
+    volatile uint32_t csr;
+    volatile uint32_t rvr;
+    volatile uint32_t cvr;
+    volatile uint32_t calib;
+} systick_hw_t;
+
+// cvr counts down at clk_sys rate from monotonic clock, writes are ignored
+systick_hw_t *host_systick(void);
+#define systick_hw  (host_systick())
+
+#endif
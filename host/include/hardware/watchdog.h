@@ -0,0 +1,13 @@
+#ifndef HOST_HARDWARE_WATCHDOG_H
+#define HOST_HARDWARE_WATCHDOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// no watchdog on host: process is never restarted with state kept
+static inline void watchdog_enable(uint32_t delay_ms, bool pause_on_debug) { (void) delay_ms; (void) pause_on_debug; }
+static inline void watchdog_update(void) { }
+static inline bool watchdog_caused_reboot(void) { return false; }
+static inline bool watchdog_enable_caused_reboot(void) { return false; }
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef HOST_PICO_STDLIB_H
+#define HOST_PICO_STDLIB_H
+
+/*
+ * pico-sdk subset for host build, implemented in host/sdk.c
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "hardware/gpio.h"
+
+#define PICO_ERROR_TIMEOUT  (-1)
+
+typedef uint64_t absolute_time_t;   // us
+
+// RAM is always initialized on host
+#define __uninitialized_ram(group)  group
+
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+void busy_wait_us_32(uint32_t us);
+void busy_wait_ms(uint32_t ms);
+absolute_time_t make_timeout_time_ms(uint32_t ms);
+bool best_effort_wfe_or_timeout(absolute_time_t timeout);
+bool stdio_init_all(void);
+int getchar_timeout_us(uint32_t us);
+
+#endif
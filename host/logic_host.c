@@ -0,0 +1,21 @@
+/*
+ * Logic analyzer for host build: no pins to sample
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stdio.h>
+
+#include "logic.h"
+
+
+void logic_start(uint8_t clock_pin)
+{
+    (void) clock_pin;
+    printf("la: not available on host\n");
+}
+
+void logic_task(void)
+{
+}
@@ -0,0 +1,63 @@
+/*
+ * Host build: command line options and firmware main loop
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "host.h"
+#include "ps2.h"
+
+
+// main() of ps2.c
+int firmware_main(void);
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: ps2host [-c|-f] [-d] [input]\n"
+            "       ps2host -b\n"
+            "  input   bytes sent by keyboard: file, pipe or pty, stdin by default\n"
+            "  -c      input is capture dump('c' command) replayed with its timing\n"
+            "  -f      input is capture dump replayed at full speed, bytes/s and\n"
+            "          events/s are printed at its end\n"
+            "  -d      print reports on stdout instead of creating uhid devices\n"
+            "  -b      run microbenchmarks of hot paths and exit\n"
+            "Console commands are read from stdin when input is given.\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    bool capture = false;
+    bool fast = false;
+    bool dump = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "bcdfh")) != -1) {
+        switch (opt) {
+            case 'b': ps2_microbench(); return 0;
+            case 'c': capture = true; break;
+            case 'd': dump = true; break;
+            case 'f': capture = fast = true; break;
+            default: usage();
+        }
+    }
+
+    FILE *in = stdin;
+    if (optind < argc) {
+        in = fopen(argv[optind], "r");
+        if (!in) {
+            perror(argv[optind]);
+            return 1;
+        }
+        host_console_fd = STDIN_FILENO;
+    }
+    host_port_input(in, capture, fast);
+    host_usb_dump(dump);
+
+    return firmware_main();
+}
@@ -0,0 +1,263 @@
+/*
+ * PS/2 line driver for host build: emulated keyboard
+ *
+ * Port on HOST_KEYBOARD_PIN has a keyboard which answers commands as IBM
+ * Model M(ID AB83, Code Set 2) does and sends bytes of input stream as its
+ * scan codes once identified with F2. Nothing is connected to other ports.
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include "pico/stdlib.h"
+#include "bsp/board.h"
+
+#include "ps2_port.h"
+#include "ps2.h"
+#include "capture.h"
+#include "host.h"
+
+
+#define INPUT_EOF_WAIT  200     // ms, for pipeline to send the last reports
+
+static ps2_port_t *keyboard_port = NULL;
+
+// emulated keyboard
+static struct {
+    uint8_t arg;        // command waiting for its argument: ED, F0 or F3
+    bool enabled;       // identified by host, sending input
+} kbd;
+
+static FILE *input = NULL;
+static bool input_capture = false;
+static bool input_fast = false;     // capture entries back to back
+static uint32_t input_eof_ms = 0;
+static uint32_t input_bytes = 0;
+
+// capture replay: next 'R' entry and time base
+static int16_t next_data = -1;
+static uint32_t next_time;
+static uint32_t capture_t0;
+static uint32_t replay_start;
+
+void host_port_input(FILE *in, bool capture, bool fast)
+{
+    input = in;
+    input_capture = capture;
+    input_fast = fast;
+}
+
+// throughput of fast replay up to the last byte
+static void replay_print(void)
+{
+    uint32_t elapsed = time_us_32() - replay_start;
+    keyboard_t *k = ps2_keyboard(0);
+    uint32_t events = k ? k->stats.events : 0;
+    if (!elapsed) elapsed = 1;
+    printf("\nhost: replay bytes=%lu events=%lu time=%luus bytes/s=%lu events/s=%lu\n",
+            (unsigned long) input_bytes, (unsigned long) events, (unsigned long) elapsed,
+            (unsigned long) ((uint64_t) input_bytes * 1000000 / elapsed),
+            (unsigned long) ((uint64_t) events * 1000000 / elapsed));
+}
+
+static void respond(ps2_port_t *port, uint8_t data)
+{
+    ringbuf_put(&port->rbuf, data);
+    port->timing.rx_time = time_us_32();
+}
+
+static void keyboard_command(ps2_port_t *port, uint8_t data)
+{
+    if (kbd.arg) {
+        respond(port, 0xFA);
+        if (kbd.arg == 0xF0 && data == 0x00) respond(port, 0x02);   // current code set
+        kbd.arg = 0;
+        return;
+    }
+    switch (data) {
+        case 0xFF:
+            respond(port, 0xFA);
+            respond(port, 0xAA);
+            kbd.enabled = false;
+            break;
+        case 0xF2:
+            respond(port, 0xFA);
+            respond(port, 0xAB);
+            respond(port, 0x83);
+            kbd.enabled = true;
+            break;
+        case 0xEE:
+            respond(port, 0xEE);
+            break;
+        case 0xF4:
+            respond(port, 0xFA);
+            kbd.enabled = true;
+            break;
+        case 0xF5:
+            respond(port, 0xFA);
+            kbd.enabled = false;
+            break;
+        case 0xED:
+        case 0xF0:
+        case 0xF3:
+            kbd.arg = data;
+            respond(port, 0xFA);
+            break;
+        default:
+            respond(port, 0xFA);
+            break;
+    }
+}
+
+static int16_t input_eof(void)
+{
+    if (!input_eof_ms) {
+        input_eof_ms = board_millis();
+        if (!input_eof_ms) input_eof_ms = 1;
+        if (input_fast && replay_start) replay_print();
+    }
+    if (board_millis() - input_eof_ms >= INPUT_EOF_WAIT) {
+        printf("\nhost: end of input\n");
+        exit(0);
+    }
+    return -1;
+}
+
+static int16_t input_raw(void)
+{
+    struct pollfd pfd = { .fd = fileno(input), .events = POLLIN };
+    if (poll(&pfd, 1, 0) <= 0) return -1;
+
+    uint8_t c;
+    if (read(pfd.fd, &c, 1) != 1) return input_eof();
+    return c;
+}
+
+// capture dump: "time pin type data" per line
+static int16_t input_replay(void)
+{
+    char line[64];
+    while (next_data == -1) {
+        if (!fgets(line, sizeof(line), input)) return input_eof();
+
+        unsigned long time;
+        unsigned pin, data;
+        char type;
+        if (sscanf(line, "%lu %u %c %x", &time, &pin, &type, &data) != 4) continue;
+        if (type != CAPTURE_RECV || pin != HOST_KEYBOARD_PIN) continue;
+
+        if (!replay_start) {
+            capture_t0 = (uint32_t) time;
+            replay_start = time_us_32();
+            if (!replay_start) replay_start = 1;
+        }
+        next_data = (int16_t) (data & 0xFF);
+        next_time = (uint32_t) time - capture_t0;
+    }
+    if (!input_fast && time_us_32() - replay_start < next_time) return -1;
+
+    int16_t c = next_data;
+    next_data = -1;
+    return c;
+}
+
+static int16_t input_read(ps2_port_t *port)
+{
+    if (!input || input_eof_ms) return input ? input_eof() : -1;
+
+    int16_t c = input_capture ? input_replay() : input_raw();
+    if (c != -1) {
+        input_bytes++;
+        port->timing.frames++;
+        port->timing.rx_time = time_us_32();
+    }
+    return c;
+}
+
+void ps2_port_init(ps2_port_t *port)
+{
+    ringbuf_init(&port->rbuf, port->buf, PS2_BUF_SIZE);
+    port->error = PS2_ERR_NONE;
+    port->response_timeout = PS2_TIMEOUT_RESPONSE;
+    ps2_port_timing_reset(port);
+
+    if (port->clock_pin == HOST_KEYBOARD_PIN) {
+        keyboard_port = port;
+        respond(port, 0xAA);    // BAT at power-on
+    }
+}
+
+int16_t ps2_port_recv(ps2_port_t *port)
+{
+    int16_t c = ringbuf_get(&port->rbuf);
+    if (c != -1) return c;
+    if (port != keyboard_port || !kbd.enabled) return -1;
+    return input_read(port);
+}
+
+bool ps2_port_inject(ps2_port_t *port, const uint8_t *data, uint8_t len)
+{
+    if (ringbuf_free(&port->rbuf) < len) return false;
+    for (uint8_t i = 0; i < len; i++) ringbuf_put(&port->rbuf, data[i]);
+    return true;
+}
+
+int16_t ps2_port_recv_response(ps2_port_t *port)
+{
+    int16_t c = ringbuf_get(&port->rbuf);
+    if (c == -1) {
+        port->timing.timeouts++;
+        return -1;
+    }
+    printf("r%02X ", c & 0xFF);
+    capture_record(port->clock_pin, CAPTURE_RESPONSE, (uint8_t) c);
+    return c;
+}
+
+int16_t ps2_port_send(ps2_port_t *port, uint8_t data)
+{
+    printf("s%02X ", data);
+    capture_record(port->clock_pin, CAPTURE_SEND, data);
+
+    if (port != keyboard_port) {
+        // no clock from device: RTS timeout
+        port->timing.timeouts++;
+        printf("e%02X ", 1);
+        capture_record(port->clock_pin, CAPTURE_ERROR, 1);
+        return -0xf;
+    }
+
+    ringbuf_reset(&port->rbuf);
+    keyboard_command(port, data);
+    port->timing.commands++;
+    return ps2_port_recv_response(port);
+}
+
+void ps2_port_inhibit(ps2_port_t *port)
+{
+    (void) port;
+}
+
+void ps2_port_idle(ps2_port_t *port)
+{
+    (void) port;
+}
+
+void ps2_port_timing_reset(ps2_port_t *port)
+{
+    memset(&port->timing, 0, sizeof(port->timing));
+    port->timing.period_min = 0xFFFF;
+}
+
+void ps2_port_print_timing(ps2_port_t *port)
+{
+    printf("  frames:%lu commands:%lu timeouts:%lu(emulated)\n",
+            (unsigned long) port->timing.frames,
+            (unsigned long) port->timing.commands,
+            (unsigned long) port->timing.timeouts);
+}
@@ -0,0 +1,110 @@
+/*
+ * pico-sdk and board shim for host build
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stdio.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "hardware/address_mapped.h"
+#include "bsp/board.h"
+
+#include "host.h"
+
+
+int host_console_fd = -1;
+uint32_t host_nvic_ispr = 0;
+
+static uint64_t start_ns;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+// time since startup as on target
+uint64_t time_us_64(void)
+{
+    if (!start_ns) start_ns = now_ns();
+    return (now_ns() - start_ns) / 1000;
+}
+
+uint32_t time_us_32(void)
+{
+    return (uint32_t) time_us_64();
+}
+
+void busy_wait_us_32(uint32_t us)
+{
+    uint64_t end = now_ns() + (uint64_t) us * 1000;
+    while (now_ns() < end) ;
+}
+
+void busy_wait_ms(uint32_t ms)
+{
+    busy_wait_us_32(ms * 1000);
+}
+
+absolute_time_t make_timeout_time_ms(uint32_t ms)
+{
+    return time_us_64() + (uint64_t) ms * 1000;
+}
+
+// no event to wait for: sleeps until timeout
+bool best_effort_wfe_or_timeout(absolute_time_t timeout)
+{
+    uint64_t now = time_us_64();
+    if (now < timeout) usleep((useconds_t) (timeout - now));
+    return true;
+}
+
+bool stdio_init_all(void)
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    return true;
+}
+
+int getchar_timeout_us(uint32_t us)
+{
+    if (host_console_fd < 0) return PICO_ERROR_TIMEOUT;
+
+    struct pollfd pfd = { .fd = host_console_fd, .events = POLLIN };
+    if (poll(&pfd, 1, (int) (us / 1000)) <= 0) return PICO_ERROR_TIMEOUT;
+
+    unsigned char c;
+    if (read(host_console_fd, &c, 1) != 1) {
+        host_console_fd = -1;   // closed
+        return PICO_ERROR_TIMEOUT;
+    }
+    return c;
+}
+
+void board_init(void)
+{
+    time_us_64();
+}
+
+uint32_t board_millis(void)
+{
+    return (uint32_t) (time_us_64() / 1000);
+}
+
+void board_led_write(bool state)
+{
+    (void) state;
+}
+
+systick_hw_t *host_systick(void)
+{
+    static systick_hw_t systick;
+    systick.cvr = (uint32_t) ~(now_ns() * (HOST_CLK_SYS_HZ / 1000000) / 1000) & 0x00FFFFFF;
+    return &systick;
+}
@@ -0,0 +1,356 @@
+/*
+ * TinyUSB device API for host build: HID interfaces on Linux uhid
+ *
+ * One uhid device is created per HID interface of configuration descriptor
+ * with its report descriptor from tud_hid_descriptor_report_cb(), so kernel
+ * parses the same descriptors as on USB. Reports are written as soon as they
+ * are submitted; USB polling interval is not emulated. SOF is emulated every
+ * millisecond of main loop while mounted.
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <linux/uhid.h>
+#include "tusb.h"
+#include "device/usbd_pvt.h"
+#include "bsp/board.h"
+
+#include "host.h"
+
+
+#define HID_INSTANCE_MAX    4
+
+static struct {
+    int fd;
+    bool started;
+    bool report_id;     // reports are prefixed with ID
+    uint8_t ep_in;
+    uint8_t epin_buf[CFG_TUD_HID_EP_BUFSIZE];   // as HID class driver: completion gets this
+} hid[HID_INSTANCE_MAX];
+static uint8_t hid_count = 0;
+
+static bool dump = false;
+static bool mounted = false;
+static bool sof_enabled = false;
+static uint32_t sof_ms;
+static uint32_t frame_count;
+
+void host_usb_dump(bool d)
+{
+    dump = d;
+}
+
+// report descriptor uses Report ID item(0x85)
+static bool desc_has_report_id(uint8_t const *desc, uint16_t len)
+{
+    for (uint16_t i = 0; i < len; ) {
+        uint8_t prefix = desc[i];
+        if (prefix == 0xFE) {   // long item
+            if (i + 1 >= len) break;
+            i = (uint16_t) (i + 3 + desc[i + 1]);
+            continue;
+        }
+        if ((prefix & 0xFC) == 0x84) return true;
+        uint8_t size = prefix & 0x03;
+        i = (uint16_t) (i + 1 + (size == 3 ? 4 : size));
+    }
+    return false;
+}
+
+// ASCII of UTF-16 string descriptor
+static void string_desc(uint8_t index, char *buf, size_t size)
+{
+    uint16_t const *desc = tud_descriptor_string_cb(index, 0x0409);
+    size_t n = desc ? ((desc[0] & 0xFF) - 2) / 2 : 0;
+    if (n > size - 1) n = size - 1;
+    for (size_t i = 0; i < n; i++) buf[i] = (char) desc[1 + i];
+    buf[n] = '\0';
+}
+
+static bool uhid_write(uint8_t instance, struct uhid_event *ev)
+{
+    if (write(hid[instance].fd, ev, sizeof(*ev)) != sizeof(*ev)) {
+        perror("uhid write");
+        return false;
+    }
+    return true;
+}
+
+static bool uhid_create(uint8_t instance, uint16_t desc_len)
+{
+    uint8_t const *desc = tud_hid_descriptor_report_cb(instance);
+    if (!desc || desc_len > UHID_DATA_MAX) return false;
+
+    hid[instance].report_id = desc_has_report_id(desc, desc_len);
+    if (dump) {
+        hid[instance].started = true;
+        return true;
+    }
+
+    hid[instance].fd = open("/dev/uhid", O_RDWR | O_CLOEXEC | O_NONBLOCK);
+    if (hid[instance].fd < 0) {
+        perror("/dev/uhid");
+        return false;
+    }
+
+    tusb_desc_device_t const *dev = (tusb_desc_device_t const *) tud_descriptor_device_cb();
+    struct uhid_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_CREATE2;
+    string_desc(dev->iProduct, (char *) ev.u.create2.name, sizeof(ev.u.create2.name));
+    snprintf((char *) ev.u.create2.phys, sizeof(ev.u.create2.phys), "uhid/input%u", instance);
+    string_desc(dev->iSerialNumber, (char *) ev.u.create2.uniq, sizeof(ev.u.create2.uniq));
+    ev.u.create2.rd_size = desc_len;
+    ev.u.create2.bus = BUS_USB;
+    ev.u.create2.vendor = dev->idVendor;
+    ev.u.create2.product = dev->idProduct;
+    ev.u.create2.version = dev->bcdDevice;
+    memcpy(ev.u.create2.rd_data, desc, desc_len);
+    return uhid_write(instance, &ev);
+}
+
+// HID descriptor follows each HID interface descriptor and has length of
+// report descriptor
+bool tud_init(uint8_t rhport)
+{
+    (void) rhport;
+    uint8_t const *p = tud_descriptor_configuration_cb(0);
+    uint16_t total = (uint16_t) (p[2] | p[3] << 8);
+    uint8_t const *end = p + total;
+    bool hid_itf = false;
+
+    for (; p < end && p[0]; p += p[0]) {
+        if (p[1] == TUSB_DESC_INTERFACE) {
+            hid_itf = (p[5] == TUSB_CLASS_HID);
+        } else if (p[1] == HID_DESC_TYPE_HID && hid_itf && hid_count < HID_INSTANCE_MAX) {
+            if (!uhid_create(hid_count, (uint16_t) (p[7] | p[8] << 8))) exit(1);
+            hid_count++;
+        } else if (p[1] == TUSB_DESC_ENDPOINT && hid_itf && (p[2] & 0x80)) {
+            hid[hid_count - 1].ep_in = p[2];
+        }
+    }
+    return true;
+}
+
+// kernel requests: start/stop, LED output and control requests
+static void uhid_event(uint8_t instance)
+{
+    struct uhid_event ev, reply;
+    if (read(hid[instance].fd, &ev, sizeof(ev)) <= 0) return;
+
+    memset(&reply, 0, sizeof(reply));
+    switch (ev.type) {
+        case UHID_START:
+            hid[instance].started = true;
+            break;
+        case UHID_STOP:
+            hid[instance].started = false;
+            break;
+        case UHID_OUTPUT: {
+            uint8_t *data = ev.u.output.data;
+            uint16_t size = ev.u.output.size;
+            uint8_t report_id = 0;
+            // report ID of hidraw write is passed through, zero means none
+            if (size > 1 && (hid[instance].report_id || data[0] == 0)) {
+                report_id = data[0];
+                data++;
+                size--;
+            }
+            tud_hid_set_report_cb(instance, report_id,
+                    ev.u.output.rtype == UHID_FEATURE_REPORT ? HID_REPORT_TYPE_FEATURE : HID_REPORT_TYPE_OUTPUT,
+                    data, size);
+            break;
+        }
+        case UHID_GET_REPORT: {
+            hid_report_type_t type = ev.u.get_report.rtype == UHID_FEATURE_REPORT ? HID_REPORT_TYPE_FEATURE :
+                                     ev.u.get_report.rtype == UHID_OUTPUT_REPORT ? HID_REPORT_TYPE_OUTPUT :
+                                     HID_REPORT_TYPE_INPUT;
+            // report number comes first also when it is zero(none)
+            uint8_t *data = reply.u.get_report_reply.data;
+            data[0] = ev.u.get_report.rnum;
+            uint16_t len = tud_hid_get_report_cb(instance, ev.u.get_report.rnum, type,
+                    data + 1, UHID_DATA_MAX - 1);
+            reply.type = UHID_GET_REPORT_REPLY;
+            reply.u.get_report_reply.id = ev.u.get_report.id;
+            reply.u.get_report_reply.err = len ? 0 : EIO;
+            reply.u.get_report_reply.size = (uint16_t) (len ? len + 1 : 0);
+            uhid_write(instance, &reply);
+            break;
+        }
+        case UHID_SET_REPORT: {
+            uint8_t *data = ev.u.set_report.data;
+            uint16_t size = ev.u.set_report.size;
+            if (size) {
+                data++;     // report number
+                size--;
+            }
+            tud_hid_set_report_cb(instance, ev.u.set_report.rnum,
+                    ev.u.set_report.rtype == UHID_FEATURE_REPORT ? HID_REPORT_TYPE_FEATURE : HID_REPORT_TYPE_OUTPUT,
+                    data, size);
+            reply.type = UHID_SET_REPORT_REPLY;
+            reply.u.set_report_reply.id = ev.u.set_report.id;
+            uhid_write(instance, &reply);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+#if TUSB_VERSION_MAJOR > 0 || TUSB_VERSION_MINOR >= 14
+void tud_task_ext(uint32_t timeout_ms, bool in_isr)
+{
+    (void) timeout_ms;
+    (void) in_isr;
+#else
+void tud_task(void)
+{
+#endif
+    if (!dump) {
+        struct pollfd pfd[HID_INSTANCE_MAX];
+        for (uint8_t i = 0; i < hid_count; i++) {
+            pfd[i] = (struct pollfd) { .fd = hid[i].fd, .events = POLLIN };
+        }
+        if (poll(pfd, hid_count, 0) > 0) {
+            for (uint8_t i = 0; i < hid_count; i++) {
+                if (pfd[i].revents & POLLIN) uhid_event(i);
+            }
+        }
+    }
+
+    // mounted when kernel has started all devices
+    bool started = hid_count > 0;
+    for (uint8_t i = 0; i < hid_count; i++) started = started && hid[i].started;
+    if (started != mounted) {
+        mounted = started;
+        if (mounted) tud_mount_cb(); else tud_umount_cb();
+    }
+
+    if (sof_enabled && mounted && board_millis() != sof_ms) {
+        sof_ms = board_millis();
+        tud_sof_cb(frame_count++ & 0x7FF);
+    }
+}
+
+void tud_sof_cb_enable(bool en)
+{
+    sof_enabled = en;
+}
+
+bool tud_mounted(void)
+{
+    return mounted;
+}
+
+bool tud_suspended(void)
+{
+    return false;
+}
+
+bool tud_remote_wakeup(void)
+{
+    return false;
+}
+
+bool tud_hid_n_ready(uint8_t instance)
+{
+    return instance < hid_count && hid[instance].started;
+}
+
+uint8_t tud_hid_n_get_protocol(uint8_t instance)
+{
+    (void) instance;
+    return HID_PROTOCOL_REPORT;
+}
+
+// data is written to uhid as is: ID prefixed when used
+static bool hid_input(uint8_t instance, uint8_t const *data, uint16_t size)
+{
+    if (dump) {
+        printf("\nhid[%u]:", instance);
+        for (uint16_t i = 0; i < size; i++) printf(" %02X", data[i]);
+        printf("\n");
+        return true;
+    }
+
+    struct uhid_event ev;
+    ev.type = UHID_INPUT2;
+    ev.u.input2.size = size < UHID_DATA_MAX ? size : UHID_DATA_MAX;
+    memcpy(ev.u.input2.data, data, ev.u.input2.size);
+    return uhid_write(instance, &ev);
+}
+
+// Report is copied into buffer of the class driver and the completion is
+// notified with that buffer, ID included, as TinyUSB does.
+bool tud_hid_n_report(uint8_t instance, uint8_t report_id, void const *report, uint16_t len)
+{
+    if (!tud_hid_n_ready(instance)) return false;
+
+    uint8_t *data = hid[instance].epin_buf;
+    uint16_t size = 0;
+    if (report_id) data[size++] = report_id;
+    if (len > sizeof(hid[instance].epin_buf) - size) len = (uint16_t) (sizeof(hid[instance].epin_buf) - size);
+    memcpy(data + size, report, len);
+    size = (uint16_t) (size + len);
+
+    if (!hid_input(instance, data, size)) return false;
+    tud_hid_report_complete_cb(instance, data, size);
+    return true;
+}
+
+// Endpoint access bypassing HID class driver: only IN endpoints of HID
+// interfaces. Transfer completes immediately, and as in TinyUSB completion
+// is notified with buffer of the class driver, not with the one transferred.
+bool usbd_edpt_claim(uint8_t rhport, uint8_t ep_addr)
+{
+    (void) rhport;
+    (void) ep_addr;
+    return true;
+}
+
+bool usbd_edpt_release(uint8_t rhport, uint8_t ep_addr)
+{
+    (void) rhport;
+    (void) ep_addr;
+    return true;
+}
+
+bool usbd_edpt_busy(uint8_t rhport, uint8_t ep_addr)
+{
+    (void) rhport;
+    (void) ep_addr;
+    return false;
+}
+
+bool usbd_edpt_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t *buffer, uint16_t total_bytes)
+{
+    (void) rhport;
+    for (uint8_t i = 0; i < hid_count; i++) {
+        if (hid[i].ep_in != ep_addr) continue;
+        if (!tud_hid_n_ready(i) || !hid_input(i, buffer, total_bytes)) return false;
+        tud_hid_report_complete_cb(i, hid[i].epin_buf, total_bytes);
+        return true;
+    }
+    return false;
+}
+
+bool tud_hid_n_mouse_report(uint8_t instance, uint8_t report_id,
+                            uint8_t buttons, int8_t x, int8_t y, int8_t vertical, int8_t horizontal)
+{
+    hid_mouse_report_t report = {
+        .buttons = buttons,
+        .x = x,
+        .y = y,
+        .wheel = vertical,
+        .pan = horizontal,
+    };
+    return tud_hid_n_report(instance, report_id, &report, sizeof(report));
+}
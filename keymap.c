@@ -0,0 +1,69 @@
+/*
+ * Keymap: Code Set 2 to HID usage and Fn layers
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stdint.h>
+#include "action.h"
+
+
+// Layer 0
+// AF(Application): Layer Tap, Fn layer 1 while holding and Application on tap
+// Code Set 2 -> HID(Usage page << 12 | Usage ID)
+// Usage page: 0x0(Keyboard by default), 0x7(Keyboard), 0xC(Consumer), 0x1(Generic Desktiop/System Control)
+// https://github.com/tmk/tmk_keyboard/wiki/IBM-PC-AT-Keyboard-Protocol#code-set-2-to-hid-usage
+static uint16_t cs2_to_hid[256] = {
+    //   0       1       2       3       4       5       6       7       8       9       A       B       C       D       E       F
+    0x0000, 0x0042, 0x0000, 0x003E, 0x003C, 0x003A, 0x003B, 0x0045, 0x0068, 0x0043, 0x0041, 0x003F, 0x003D, 0x002B, 0x0035, 0x0067, // 0
+    0x0069, 0x00E2, 0x00E1, 0x0088, 0x00E0, 0x0014, 0x001E, 0x0000, 0x006A, 0x0000, 0x001D, 0x0016, 0x0004, 0x001A, 0x001F, 0x0000, // 1
+    0x006B, 0x0006, 0x001B, 0x0007, 0x0008, 0x0021, 0x0020, 0x008C, 0x006C, 0x002C, 0x0019, 0x0009, 0x0017, 0x0015, 0x0022, 0x0000, // 2
+    0x006D, 0x0011, 0x0005, 0x000B, 0x000A, 0x001C, 0x0023, 0x0000, 0x006E, 0x0000, 0x0010, 0x000D, 0x0018, 0x0024, 0x0025, 0x0000, // 3
+    0x006F, 0x0036, 0x000E, 0x000C, 0x0012, 0x0027, 0x0026, 0x0000, 0x0070, 0x0037, 0x0038, 0x000F, 0x0033, 0x0013, 0x002D, 0x0000, // 4
+    0x0071, 0x0087, 0x0034, 0x0000, 0x002F, 0x002E, 0x0000, 0x0072, 0x0039, 0x00E5, 0x0028, 0x0030, 0x0000, 0x0031, 0x0000, 0x0073, // 5
+    0x0000, 0x0064, 0x0093, 0x0092, 0x008A, 0x0000, 0x002A, 0x008B, 0x0000, 0x0059, 0x0089, 0x005C, 0x005F, 0x0085, 0x0000, 0x0000, // 6
+    0x0062, 0x0063, 0x005A, 0x005D, 0x005E, 0x0060, 0x0029, 0x0053, 0x0044, 0x0057, 0x005B, 0x0056, 0x0055, 0x0061, 0x0047, 0x0046, // 7
+    0x0000, 0x0000, 0x0000, 0x0040, 0x0046, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, // 8
+    0xC221, 0x00E6, 0x0000, 0x0000, 0x00E4, 0xC0B6, 0x0000, 0x0000, 0xC22A, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x00E3, // 9
+    0xC227, 0xC0EA, 0x0000, 0xC0E2, 0x0000, 0x0000, 0x0000, 0x00E7, 0xC226, 0x0000, 0x0000, 0xC192, 0x0000, 0x0000, 0x0000, 0x2165, // A
+    0xC225, 0x0000, 0xC0E9, 0x0000, 0xC0CD, 0x0000, 0x0000, 0x1081, 0xC224, 0x0000, 0xC223, 0xC0B7, 0x0000, 0x0000, 0x0000, 0x1082, // B
+    0xC194, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0xC18A, 0x0000, 0x0054, 0x0000, 0x0000, 0xC0B5, 0x0000, 0x0000, // C
+    0xC183, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0058, 0x0000, 0x0000, 0x0000, 0x1083, 0x0000, // D
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x004D, 0x0000, 0x0050, 0x004A, 0x0000, 0x0000, 0x0000, // E
+    0x0049, 0x004C, 0x0051, 0x0000, 0x004F, 0x0052, 0x0000, 0x0048, 0x0000, 0x0000, 0x004E, 0x0000, 0x0046, 0x004B, 0x0048, 0x0000, // F
+};
+
+// Layer 1: Fn layer while holding Application(Menu) key
+static uint16_t keymap_fn[256] = {
+    [0x05] = 0xC0E2,    // F1:          Mute
+    [0x06] = 0xC0EA,    // F2:          Volume Down
+    [0x04] = 0xC0E9,    // F3:          Volume Up
+    [0x03] = 0xC0B6,    // F5:          Previous Track
+    [0x0B] = 0xC0CD,    // F6:          Play/Pause
+    [0x83] = 0xC0B5,    // F7:          Next Track
+    [0x33] = 0x0050,    // H:           Left
+    [0x3B] = 0x0051,    // J:           Down
+    [0x42] = 0x0052,    // K:           Up
+    [0x4B] = 0x004F,    // L:           Right
+    [0x66] = ACTION_MACRO(0),   // Backspace: delete word
+};
+
+// Layers are in RAM so that they can be changed from host through raw HID.
+// Changes are not saved and lost on reset.
+uint16_t * const keymaps[] = {
+    cs2_to_hid,
+    keymap_fn,
+};
+const uint8_t keymap_layers = sizeof(keymaps) / sizeof(keymaps[0]);
+_Static_assert(sizeof(keymaps) / sizeof(keymaps[0]) <= 32, "layer_state is 32-bit");
+
+
+static const uint8_t macro_delete_word[] = {
+    MACRO_DOWN(0xE0), MACRO_TYPE(0x2A), MACRO_UP(0xE0), MACRO_END
+};
+
+const uint8_t * const macros[] = {
+    macro_delete_word,
+};
+const uint8_t macro_count = sizeof(macros) / sizeof(macros[0]);
@@ -0,0 +1,90 @@
+/*
+ * Logic analyzer on PS/2 pins
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+
+#include "logic.h"
+#include "recover.h"
+#include "logic.pio.h"
+
+
+static uint32_t samples[LOGIC_WORDS];
+
+static PIO pio = pio0;
+static int sm = -1;
+static int dma_chan = -1;
+static uint offset;
+static bool armed = false;
+
+void logic_start(uint8_t clock_pin)
+{
+    if (armed) return;
+
+    if (sm < 0) {
+        sm = pio_claim_unused_sm(pio, true);
+        dma_chan = dma_claim_unused_channel(true);
+        offset = pio_add_program(pio, &logic_program);
+    }
+
+    // pins are only read by PIO, they are still driven by GPIO
+    pio_sm_config c = logic_program_get_default_config(offset);
+    sm_config_set_in_pins(&c, clock_pin);
+    sm_config_set_in_shift(&c, true, true, 32);     // shift right, autopush
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+    sm_config_set_clkdiv(&c, (float) clock_get_hz(clk_sys) / LOGIC_RATE);
+    pio_sm_init(pio, (uint) sm, offset, &c);
+
+    dma_channel_config dc = dma_channel_get_default_config((uint) dma_chan);
+    channel_config_set_transfer_data_size(&dc, DMA_SIZE_32);
+    channel_config_set_read_increment(&dc, false);
+    channel_config_set_write_increment(&dc, true);
+    channel_config_set_dreq(&dc, pio_get_dreq(pio, (uint) sm, false));
+    dma_channel_configure((uint) dma_chan, &dc, samples, &pio->rxf[sm], LOGIC_WORDS, true);
+
+    pio_sm_set_enabled(pio, (uint) sm, true);
+    armed = true;
+    printf("la: armed pin:%u/%u\n", clock_pin, clock_pin + 1);
+}
+
+static void logic_dump(void)
+{
+    printf("\nla: rate=%u samples=%u\n", LOGIC_RATE, LOGIC_WORDS * 16);
+
+    uint8_t state = samples[0] & 0x3;
+    uint32_t run = 0;
+    uint8_t n = 0;
+    for (uint32_t i = 0; i < LOGIC_WORDS; i++) {
+        uint32_t w = samples[i];
+        // first sample is in the lowest bits
+        for (uint8_t j = 0; j < 16; j++, w >>= 2) {
+            if ((w & 0x3) == state) {
+                run++;
+                continue;
+            }
+            printf("%u:%lu%c", state, (unsigned long) run, (++n & 0xF) ? ' ' : '\n');
+            state = w & 0x3;
+            run = 1;
+        }
+    }
+    printf("%u:%lu\nend\n", state, (unsigned long) run);
+}
+
+void logic_task(void)
+{
+    if (!armed) return;
+    if (dma_channel_is_busy((uint) dma_chan)) return;
+
+    pio_sm_set_enabled(pio, (uint) sm, false);
+    armed = false;
+    // dump may block on CDC
+    recover_hold(RECOVER_COMMAND_MS);
+    logic_dump();
+}
@@ -0,0 +1,23 @@
+#ifndef LOGIC_H
+#define LOGIC_H
+
+#include <stdint.h>
+
+/*
+ * Logic analyzer: PIO samples clock/data pins into RAM via DMA
+ *
+ * Capture is triggered at the first falling edge of clock and dumped on CDC
+ * in run-length format when the buffer is filled:
+ *
+ *   la: rate=<Hz> samples=<n>
+ *   <state>:<length> ...       state bit0: clock, bit1: data
+ *   end
+ */
+#define LOGIC_RATE      1000000     // samples per second
+#define LOGIC_WORDS     4096        // 16 samples per word: 65ms at 1MHz
+
+// clock_pin + 1 must be data pin
+void logic_start(uint8_t clock_pin);
+void logic_task(void);
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ * Interrupt-masked time per call site
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "masked.h"
+
+
+masked_t masked_sites[MASKED_COUNT];
+masked_isr_t masked_isr;
+
+void masked_print(void)
+{
+    static const char * const names[MASKED_COUNT] = { "recv", "inject", "send" };
+    for (uint8_t i = 0; i < MASKED_COUNT; i++) {
+        masked_t *m = &masked_sites[i];
+        printf("%-6s count:%lu max:%lucyc avg:%lucyc blocked:%lu blocked_max:%lucyc\n", names[i],
+                (unsigned long) m->count,
+                (unsigned long) m->cycles_max,
+                (unsigned long) (m->count ? m->cycles_total / m->count : 0),
+                (unsigned long) m->blocked,
+                (unsigned long) m->blocked_max);
+    }
+    printf("isr    edges:%lu late:%lu\n",
+            (unsigned long) masked_isr.edges,
+            (unsigned long) masked_isr.late);
+}
+
+void masked_clear(void)
+{
+    memset(masked_sites, 0, sizeof(masked_sites));
+    memset(&masked_isr, 0, sizeof(masked_isr));
+}
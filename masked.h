@@ -0,0 +1,84 @@
+#ifndef MASKED_H
+#define MASKED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hardware/sync.h"
+#include "hardware/irq.h"
+#include "hardware/address_mapped.h"
+#include "hardware/regs/m0plus.h"
+#include "cycles.h"
+
+/*
+ * Interrupt-masked time per call site
+ *
+ *   recv:      ps2_port_recv(), all interrupts masked for ring buffer
+ *   inject:    ps2_port_inject(), all interrupts masked for ring buffer
+ *   send:      ps2_port_send(), clock IRQ of the port off during command
+ *
+ * A site is blocked when GPIO IRQ became pending while interrupts were
+ * masked; ISR entry of that edge was delayed by up to the masked time.
+ * ISR is late when clock is already released at its entry: entry latency
+ * exceeded low phase of clock(30-50us) and data bit may be lost.
+ */
+enum {
+    MASKED_RECV,
+    MASKED_INJECT,
+    MASKED_SEND,
+    MASKED_COUNT
+};
+
+typedef struct {
+    uint32_t count;
+    uint32_t cycles_total;
+    uint32_t cycles_max;
+    uint32_t blocked;       // GPIO IRQ pending at end of section
+    uint32_t blocked_max;   // cycles, longest section with IRQ pending
+} masked_t;
+
+typedef struct {
+    uint32_t edges;
+    uint32_t late;          // clock high at ISR entry
+} masked_isr_t;
+
+extern masked_t masked_sites[MASKED_COUNT];
+extern masked_isr_t masked_isr;
+void masked_print(void);
+void masked_clear(void);
+
+static inline void masked_end(uint8_t site, uint32_t start, bool pending)
+{
+    masked_t *m = &masked_sites[site];
+    uint32_t cycles = cycles_since(start);
+    m->count++;
+    m->cycles_total += cycles;
+    if (cycles > m->cycles_max) m->cycles_max = cycles;
+    if (pending) {
+        m->blocked++;
+        if (cycles > m->blocked_max) m->blocked_max = cycles;
+    }
+}
+
+// save_and_disable_interrupts()/restore_interrupts() with measurement
+static inline uint32_t masked_disable(uint32_t *start)
+{
+    uint32_t status = save_and_disable_interrupts();
+    *start = cycles_read();
+    return status;
+}
+static inline void masked_restore(uint8_t site, uint32_t status, uint32_t start)
+{
+    // NVIC set-pending register
+    bool pending = *(io_ro_32 *) (PPB_BASE + M0PLUS_NVIC_ISPR_OFFSET) & (1u << IO_IRQ_BANK0);
+    masked_end(site, start, pending);
+    restore_interrupts(status);
+}
+
+// at entry of clock IRQ, with level of clock pin
+static inline void masked_isr_entry(bool clock)
+{
+    masked_isr.edges++;
+    if (clock) masked_isr.late++;
+}
+
+#endif
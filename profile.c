@@ -0,0 +1,35 @@
+/*
+ * Keyboard profiles
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stddef.h>
+#include "profile.h"
+
+
+// https://github.com/tmk/tmk_keyboard/wiki/IBM-PC-AT-Keyboard-Protocol#keyboard-id
+static const keyboard_profile_t profiles[] = {
+    // Set 3 of many AB83 keyboards is incomplete, use Set 2
+    { 0xAB83, PROFILE_TYPEMATIC_SLOW,   "PS/2 101/102-key" },
+    { 0xAB84, PROFILE_TYPEMATIC_SLOW,   "IBM Space Saver/ThinkPad" },
+    { 0xAB85, PROFILE_CS3,              "IBM 122-key(PS/2)" },
+    { 0xAB86, PROFILE_CS3,              "IBM 122-key(PS/2)" },
+    { 0xBFB0, PROFILE_CS3_NATIVE,       "IBM RT" },
+    { 0xBFBF, PROFILE_CS3_NATIVE,       "IBM Terminal" },
+    // AT keyboard doesn't support F2 and returns no ID
+    { 0x0000, PROFILE_TYPEMATIC_SLOW,   "AT(no ID)" },
+};
+
+// clones and KVMs may not handle F0 03 well: Set 3 only for known IDs
+static const keyboard_profile_t profile_default = { 0xFFFF, 0, "unknown" };
+
+// table is small and fixed at compile time: bounded search, done once per detection
+const keyboard_profile_t *profile_lookup(uint16_t id)
+{
+    for (size_t i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++) {
+        if (profiles[i].id == id) return &profiles[i];
+    }
+    return &profile_default;
+}
@@ -0,0 +1,23 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+/*
+ * Keyboard profile selected by keyboard ID
+ */
+#define PROFILE_CS3             0x01    // try Code Set 3 with F0 03
+#define PROFILE_CS3_NATIVE      0x02    // keyboard is in Code Set 3 after reset
+#define PROFILE_NO_LED          0x04    // don't send LED command: no LED, or no response to it
+#define PROFILE_TYPEMATIC_SLOW  0x08    // slowest typematic in Code Set 2, repeats are not used
+
+typedef struct {
+    uint16_t id;
+    uint8_t flags;
+    const char *name;
+} keyboard_profile_t;
+
+// returns default profile for unknown ID
+const keyboard_profile_t *profile_lookup(uint16_t id);
+
+#endif
@@ -1,21 +1,34 @@
 #include <stdio.h>
 #include "pico/stdlib.h"
-//#include "pico/critical_section.h"
-#include "hardware/gpio.h"
-#include "hardware/sync.h"
-#include "hardware/irq.h"
+#include "hardware/clocks.h"
 
 #include "bsp/board.h"
 #include "tusb.h"
+#include "device/usbd_pvt.h"
 #include "usb_descriptors.h"
 
-#include "ringbuf.h"
+#include "ps2_port.h"
+#include "ps2.h"
+#include "capture.h"
+#include "profile.h"
+#include "ps2_mouse.h"
+#include "action.h"
+#include "command.h"
+#include "logic.h"
+#include "cycles.h"
+#include "raw.h"
+#include "bench.h"
+#include "boot.h"
+#include "stage.h"
+#include "sof.h"
+#include "chatter.h"
+#include "recover.h"
 
 
 
 
 /*
- * PS/2(IBMPC/AT Code Set 2) keyboard converter
+ * PS/2(IBMPC/AT Code Set 2/3) keyboard converter
  *
  * License: MIT
  * Copyright 2022 Jun WAKO <wakojun@gmail.com>
@@ -23,321 +36,143 @@
  */
 #define xprintf(s, ...)         printf(s, ##__VA_ARGS__)
 
-// input pins: 2:clock(IRQ), 3:data
-#define CLOCK_PIN   2
-#define DATA_PIN    3
-
-#define PS2_ERR_NONE    0
-
-volatile int16_t ps2_error = PS2_ERR_NONE;
-
 #define PS2_LED_SCROLL_LOCK 0
 #define PS2_LED_NUM_LOCK    1
 #define PS2_LED_CAPS_LOCK   2
 
-volatile int8_t ps2_led = -1;
-uint16_t ps2_kbd_id = 0xFFFF;
+// main loop sleeps while keyboards are quiesced
+#define QUIESCE_SLEEP_MS    10
 
+volatile int8_t ps2_led = -1;
 
-#define BUF_SIZE 16
-static uint8_t buf[BUF_SIZE];
-static ringbuf_t rbuf = {
-    .buffer = buf,
-    .head = 0,
-    .tail = 0,
-    .size_mask = BUF_SIZE - 1
+// Keyboard ports: clock(IRQ) and data pins
+// Each keyboard has its own port and decoder state, and their keys are merged
+// into one report. Absent port costs a detection attempt every second.
+static keyboard_t keyboards[] = {
+    { .port = PS2_PORT(2, 3) },
+    //{ .port = PS2_PORT(6, 7) },
+    //{ .port = PS2_PORT(8, 9) },
+    //{ .port = PS2_PORT(10, 11) },
 };
+#define KEYBOARD_COUNT  (sizeof(keyboards) / sizeof(keyboards[0]))
 
-#define wait_us(us)     busy_wait_us_32(us)
-#define wait_ms(ms)     busy_wait_ms(ms)
-//#define wait_us(us)     sleep_us(us)
-//#define wait_ms(ms)     sleep_ms(ms)
-#define timer_read32()  board_millis()
+// number of keyboards pressing the key position
+static uint8_t key_count[256];
 
-void ps2_callback(uint gpio, uint32_t events);
-static void ps2_init(void)
-{
-    ringbuf_reset(&rbuf);
-    gpio_init(CLOCK_PIN);
-    gpio_init(DATA_PIN);
-    gpio_set_pulls(CLOCK_PIN, true, false);
-    gpio_set_pulls(DATA_PIN, true, false);
-    gpio_set_drive_strength(CLOCK_PIN, GPIO_DRIVE_STRENGTH_12MA);
-    gpio_set_drive_strength(DATA_PIN, GPIO_DRIVE_STRENGTH_12MA);
-    gpio_set_dir(DATA_PIN, GPIO_IN);
-    gpio_set_dir(CLOCK_PIN, GPIO_IN);
-    gpio_set_irq_enabled_with_callback(CLOCK_PIN, GPIO_IRQ_EDGE_FALL, true, &ps2_callback);
-}
+// only this keyboard feeds the pipeline when set: replay
+static keyboard_t *event_source = NULL;
 
-static void int_on(void)
-{
-    gpio_set_dir(CLOCK_PIN, GPIO_IN);
-    gpio_set_dir(DATA_PIN, GPIO_IN);
-    gpio_set_irq_enabled(CLOCK_PIN, GPIO_IRQ_EDGE_FALL, true);
-}
-static void int_off(void)
-{
-    gpio_set_irq_enabled(CLOCK_PIN, GPIO_IRQ_EDGE_FALL, false);
-}
+// keyboard detection steps
+enum {
+    DETECT_BAT,     // waiting for BAT from keyboard
+    DETECT_RESET,   // reset command sent, waiting for BAT
+    DETECT_ID_1,    // ID command sent, waiting for ID bytes
+    DETECT_ID_2,
+};
+#define DETECT_BAT_WAIT     1000    // ms, BAT takes 500-750ms after power-on or reset
+#define DETECT_ID_WAIT      500     // ms
 
-static void clock_lo(void)
-{
-    gpio_set_dir(CLOCK_PIN, GPIO_OUT);
-    gpio_put(CLOCK_PIN, 0);
-}
-static inline void clock_hi(void)
-{
-    gpio_set_dir(CLOCK_PIN, GPIO_OUT);
-    gpio_put(CLOCK_PIN, 1);
-}
-static bool clock_in(void)
-{
-    gpio_set_dir(CLOCK_PIN, GPIO_IN);
-    asm("nop");
-    return gpio_get(CLOCK_PIN);
-}
+#define timer_read32()  board_millis()
 
-static void data_lo(void)
+static int16_t ps2_recv(keyboard_t *kbd)
 {
-    gpio_set_dir(DATA_PIN, GPIO_OUT);
-    gpio_put(DATA_PIN, 0);
-}
-static void data_hi(void)
-{
-    gpio_set_dir(DATA_PIN, GPIO_OUT);
-    gpio_put(DATA_PIN, 1);
-}
-static inline bool data_in(void)
-{
-    gpio_set_dir(DATA_PIN, GPIO_IN);
-    asm("nop");
-    return gpio_get(DATA_PIN);
+    int16_t c = ps2_port_recv(&kbd->port);
+    if (c != -1) printf("r%02X ", c & 0xFF);
+    if (kbd->port.error) {
+        printf("e%02X ", kbd->port.error);
+        capture_record(kbd->port.clock_pin, CAPTURE_ERROR, (uint8_t) kbd->port.error);
+        kbd->port.error = 0;
+        kbd->stats.errors++;
+    }
+    return c;
 }
 
-static void inhibit(void)
+static int16_t ps2_send(keyboard_t *kbd, uint8_t data)
 {
-    clock_lo();
-    data_hi();
-}
-static void idle(void)
-{
-    clock_hi();
-    data_hi();
+    return ps2_port_send(&kbd->port, data);
 }
 
-static inline uint16_t wait_clock_lo(uint16_t us)
-{
-    while (clock_in()  && us) { asm(""); wait_us(1); us--; }
-    return us;
-}
-static inline uint16_t wait_clock_hi(uint16_t us)
-{
-    while (!clock_in() && us) { asm(""); wait_us(1); us--; }
-    return us;
-}
-static inline uint16_t wait_data_lo(uint16_t us)
+//--------------------------------------------------------------------+
+// Pipeline: see stage.h
+//--------------------------------------------------------------------+
+stage_t stages[STAGE_COUNT];
+
+// Event queues between stages. When a queue is full its consumer stage is
+// run for one event in place so that no event is lost.
+#define EVENT_QUEUE_SIZE    16  // 2^n
+typedef struct {
+    uint16_t code;      // key position or action code
+    bool make;
+} event_t;
+
+typedef struct {
+    event_t events[EVENT_QUEUE_SIZE];
+    uint8_t head;
+    uint8_t tail;
+} event_queue_t;
+
+static event_queue_t key_events;
+static event_queue_t usage_events;
+
+static uint8_t event_queue_depth(event_queue_t *q)
 {
-    while (data_in() && us)  { asm(""); wait_us(1); us--; }
-    return us;
+    return (q->head - q->tail) & (EVENT_QUEUE_SIZE - 1);
 }
-static inline uint16_t wait_data_hi(uint16_t us)
+
+static bool event_queue_get(event_queue_t *q, event_t *e)
 {
-    while (!data_in() && us)  { asm(""); wait_us(1); us--; }
-    return us;
+    if (q->head == q->tail) return false;
+    *e = q->events[q->tail];
+    q->tail = (q->tail + 1) & (EVENT_QUEUE_SIZE - 1);
+    return true;
 }
 
-#define WAIT(stat, us, err) do { \
-    if (!wait_##stat(us)) { \
-        ps2_error = err; \
-        goto ERROR; \
-    } \
-} while (0)
+static bool map_stage(void);
+static bool report_stage(void);
+void pipeline_task(void);
 
-static int16_t ps2_recv(void)
+static void event_queue_put(event_queue_t *q, bool (*consumer)(void), uint16_t code, bool make)
 {
-    // There are alternative options for ciritcal section protection
-    //critical_section_t crit_rbuf;
-    //critical_section_init(&crit_rbuf);
-    //critical_section_enter_blocking(&crit_rbuf);      // disable IRQ and spin_lock
-    //irq_set_enabled(IO_IRQ_BANK0, false);             // disable only GPIO IRQ
-
-    uint32_t status = save_and_disable_interrupts();    // disable IRQ
-    int16_t c = ringbuf_get(&rbuf); // critical_section
-    restore_interrupts(status);
-
-    //irq_set_enabled(IO_IRQ_BANK0, true);
-    //critical_section_exit(&crit_rbuf);
-
-    if (c != -1) printf("r%02X ", c & 0xFF);
-    if (ps2_error) { printf("e%02X ", ps2_error); ps2_error = 0; }
-    return c;
+    if (((q->head + 1) & (EVENT_QUEUE_SIZE - 1)) == q->tail) {
+        consumer();
+    }
+    q->events[q->head] = (event_t) { .code = code, .make = make };
+    q->head = (q->head + 1) & (EVENT_QUEUE_SIZE - 1);
 }
 
-static int16_t ps2_recv_response(void)
+// Merge keys of keyboards: action is executed on first press and last release
+// of a key position. Typematic repeat is dropped here.
+static void key_event(keyboard_t *kbd, uint8_t key, bool make)
 {
-    // Command may take 25ms/20ms at most([5]p.46, [3]p.21)
-    uint8_t retry = 25;
-    int16_t c = -1;
-    while (retry-- && (c = ps2_recv()) == -1) {
-        wait_ms(1);
+    if (event_source && kbd != event_source) return;
+
+    uint8_t mask = (uint8_t) (1 << (key & 0x7));
+    if (make) {
+        if (kbd->pressed[key >> 3] & mask) return;
+        kbd->pressed[key >> 3] |= mask;
+        if (key_count[key]++ == 0 && chatter_pass(key, true)) event_queue_put(&key_events, map_stage, key, true);
+    } else {
+        if (!(kbd->pressed[key >> 3] & mask)) return;
+        kbd->pressed[key >> 3] &= (uint8_t) ~mask;
+        if (--key_count[key] == 0 && chatter_pass(key, false)) event_queue_put(&key_events, map_stage, key, false);
     }
-    return c;
+    kbd->stats.events++;
+    sof_event();
 }
 
-int16_t ps2_send(uint8_t data)
+// release keys held on keyboard lost
+static void key_release_all(keyboard_t *kbd)
 {
-    bool parity = true;
-    ps2_error = PS2_ERR_NONE;
-
-    printf("s%02X ", data);
-
-    int_off();
-
-    /* terminate a transmission if we have */
-    inhibit();
-    wait_us(200);
-
-    /* 'Request to Send' and Start bit */
-    data_lo();
-    wait_us(200);
-    clock_hi();
-    WAIT(clock_lo, 15000, 1);   // 10ms [5]p.50
-
-    /* Data bit[2-9] */
-    for (uint8_t i = 0; i < 8; i++) {
-        wait_us(15);
-        if (data&(1<<i)) {
-            parity = !parity;
-            data_hi();
-        } else {
-            data_lo();
-        }
-        WAIT(clock_hi, 100, (int16_t) (2 + i*0x10));
-        WAIT(clock_lo, 100, (int16_t) (3 + i*0x10));
-    }
-
-    /* Parity bit */
-    wait_us(15);
-    if (parity) { data_hi(); } else { data_lo(); }
-    WAIT(clock_hi, 100, 4);
-    WAIT(clock_lo, 100, 5);
-
-    /* Stop bit */
-    wait_us(15);
-    data_hi();
-
-    /* Ack */
-    WAIT(data_lo, 100, 6);    // check Ack
-    WAIT(data_hi, 100, 7);
-    WAIT(clock_hi, 100, 8);
-
-    ringbuf_reset(&rbuf);   // clear buffer
-    idle();
-    int_on();
-    return ps2_recv_response();
-ERROR:
-    printf("e%02X ", ps2_error); ps2_error = 0;
-    idle();
-    int_on();
-    return -0xf;
-}
-
-void ps2_callback(uint gpio, uint32_t events) {
-    static enum {
-        INIT,
-        START,
-        BIT0, BIT1, BIT2, BIT3, BIT4, BIT5, BIT6, BIT7,
-        PARITY,
-        STOP,
-    } state = INIT;
-    static uint8_t data = 0;
-    static uint8_t parity = 1;
-
-    // process at falling edge of clock
-    if (gpio != CLOCK_PIN) { return; }
-    if (events != GPIO_IRQ_EDGE_FALL) { return; }
-
-    state++;
-    switch (state) {
-        case START:
-            // start bit is low
-            if (data_in())
-                goto ERROR;
-            break;
-        case BIT0:
-        case BIT1:
-        case BIT2:
-        case BIT3:
-        case BIT4:
-        case BIT5:
-        case BIT6:
-        case BIT7:
-            data >>= 1;
-            if (data_in()) {
-                data |= 0x80;
-                parity++;
-            }
-            break;
-        case PARITY:
-            if (data_in()) {
-                if (!(parity & 0x01))
-                    goto ERROR;
-            } else {
-                if (parity & 0x01)
-                    goto ERROR;
-            }
-            break;
-        case STOP:
-            // stop bit is high
-            if (!data_in())
-                goto ERROR;
-            // critical section for ringbuffer - need to do nothing here
-            // because this should be called in IRQ context.
-            // Use protection in main thread when using ringuf.
-            ringbuf_put(&rbuf, data);
-            goto DONE;
-            break;
-        default:
-            goto ERROR;
+    for (uint16_t key = 0; key < 256; key++) {
+        key_event(kbd, (uint8_t) key, false);
     }
-    return;
-ERROR:
-    ps2_error = state + 0xF0;
-DONE:
-    state = INIT;
-    data = 0;
-    parity = 1;
-}
-
-// Code Set 2 -> HID(Usage page << 12 | Usage ID)
-// Usage page: 0x0(Keyboard by default), 0x7(Keyboard), 0xC(Consumer), 0x1(Generic Desktiop/System Control)
-// https://github.com/tmk/tmk_keyboard/wiki/IBM-PC-AT-Keyboard-Protocol#code-set-2-to-hid-usage
-const uint16_t cs2_to_hid[] = {
-    //   0       1       2       3       4       5       6       7       8       9       A       B       C       D       E       F
-    0x0000, 0x0042, 0x0000, 0x003E, 0x003C, 0x003A, 0x003B, 0x0045, 0x0068, 0x0043, 0x0041, 0x003F, 0x003D, 0x002B, 0x0035, 0x0067, // 0
-    0x0069, 0x00E2, 0x00E1, 0x0088, 0x00E0, 0x0014, 0x001E, 0x0000, 0x006A, 0x0000, 0x001D, 0x0016, 0x0004, 0x001A, 0x001F, 0x0000, // 1
-    0x006B, 0x0006, 0x001B, 0x0007, 0x0008, 0x0021, 0x0020, 0x008C, 0x006C, 0x002C, 0x0019, 0x0009, 0x0017, 0x0015, 0x0022, 0x0000, // 2
-    0x006D, 0x0011, 0x0005, 0x000B, 0x000A, 0x001C, 0x0023, 0x0000, 0x006E, 0x0000, 0x0010, 0x000D, 0x0018, 0x0024, 0x0025, 0x0000, // 3
-    0x006F, 0x0036, 0x000E, 0x000C, 0x0012, 0x0027, 0x0026, 0x0000, 0x0070, 0x0037, 0x0038, 0x000F, 0x0033, 0x0013, 0x002D, 0x0000, // 4
-    0x0071, 0x0087, 0x0034, 0x0000, 0x002F, 0x002E, 0x0000, 0x0072, 0x0039, 0x00E5, 0x0028, 0x0030, 0x0000, 0x0031, 0x0000, 0x0073, // 5
-    0x0000, 0x0064, 0x0093, 0x0092, 0x008A, 0x0000, 0x002A, 0x008B, 0x0000, 0x0059, 0x0089, 0x005C, 0x005F, 0x0085, 0x0000, 0x0000, // 6
-    0x0062, 0x0063, 0x005A, 0x005D, 0x005E, 0x0060, 0x0029, 0x0053, 0x0044, 0x0057, 0x005B, 0x0056, 0x0055, 0x0061, 0x0047, 0x0046, // 7
-    0x0000, 0x0000, 0x0000, 0x0040, 0x0046, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, // 8
-    0xC221, 0x00E6, 0x0000, 0x0000, 0x00E4, 0xC0B6, 0x0000, 0x0000, 0xC22A, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x00E3, // 9
-    0xC227, 0xC0EA, 0x0000, 0xC0E2, 0x0000, 0x0000, 0x0000, 0x00E7, 0xC226, 0x0000, 0x0000, 0xC192, 0x0000, 0x0000, 0x0000, 0x0065, // A
-    0xC225, 0x0000, 0xC0E9, 0x0000, 0xC0CD, 0x0000, 0x0000, 0x1081, 0xC224, 0x0000, 0xC223, 0xC0B7, 0x0000, 0x0000, 0x0000, 0x1082, // B
-    0xC194, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0xC18A, 0x0000, 0x0054, 0x0000, 0x0000, 0xC0B5, 0x0000, 0x0000, // C
-    0xC183, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0058, 0x0000, 0x0000, 0x0000, 0x1083, 0x0000, // D
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x004D, 0x0000, 0x0050, 0x004A, 0x0000, 0x0000, 0x0000, // E
-    0x0049, 0x004C, 0x0051, 0x0000, 0x004F, 0x0052, 0x0000, 0x0048, 0x0000, 0x0000, 0x004E, 0x0000, 0x0046, 0x004B, 0x0048, 0x0000, // F
-};
-
-void register_code(uint16_t code, bool make);
+    kbd->decode_state = 0;
+}
 
 // from TMK ibmpc_usb converter
-int8_t process_cs2(uint8_t code)
+int8_t process_cs2(keyboard_t *kbd, uint8_t code)
 {
-    static enum {
+    enum {
         CS2_INIT,
         CS2_F0,
         CS2_E0,
@@ -348,30 +183,31 @@ int8_t process_cs2(uint8_t code)
         CS2_E1_F0,
         CS2_E1_F0_14,
         CS2_E1_F0_14_F0,
-    } state_cs2 = CS2_INIT;
+    };
 
-    switch (state_cs2) {
+    switch (kbd->decode_state) {
         case CS2_INIT:
             switch (code) {
                 case 0xE0:
-                    state_cs2 = CS2_E0;
+                    kbd->decode_state = CS2_E0;
                     break;
                 case 0xF0:
-                    state_cs2 = CS2_F0;
+                    kbd->decode_state = CS2_F0;
                     break;
                 case 0xE1:
-                    state_cs2 = CS2_E1;
+                    kbd->decode_state = CS2_E1;
                     break;
                 case 0x00 ... 0x7F:
                 case 0x83:  // F7
                 case 0x84:  // Alt'd PrintScreen
-                    register_code(cs2_to_hid[code], true);
+                    key_event(kbd, code, true);
                     break;
                 case 0xF1:  // Korean Hanja          - not support
                 case 0xF2:  // Korean Hangul/English - not support
                     break;
                 case 0xAA:  // Self-test passed
                 case 0xFC:  // Self-test failed
+                    return -2;
                 default:    // unknown codes
                     xprintf("!CS2_INIT!\n");
                     return -1;
@@ -381,15 +217,15 @@ int8_t process_cs2(uint8_t code)
             switch (code) {
                 case 0x12:  // to be ignored
                 case 0x59:  // to be ignored
-                    state_cs2 = CS2_INIT;
+                    kbd->decode_state = CS2_INIT;
                     break;
                 case 0xF0:
-                    state_cs2 = CS2_E0_F0;
+                    kbd->decode_state = CS2_E0_F0;
                     break;
                 default:
-                    state_cs2 = CS2_INIT;
+                    kbd->decode_state = CS2_INIT;
                     if (code < 0x80) {
-                        register_code(cs2_to_hid[code | 0x80], true);
+                        key_event(kbd, code | 0x80, true);
                     } else {
                         xprintf("!CS2_E0!\n");
                         return -1;
@@ -401,11 +237,11 @@ int8_t process_cs2(uint8_t code)
                 case 0x00 ... 0x7F:
                 case 0x83:  // F7
                 case 0x84:  // Alt'd PrintScreen
-                    state_cs2 = CS2_INIT;
-                    register_code(cs2_to_hid[code], false);
+                    kbd->decode_state = CS2_INIT;
+                    key_event(kbd, code, false);
                     break;
                 default:
-                    state_cs2 = CS2_INIT;
+                    kbd->decode_state = CS2_INIT;
                     xprintf("!CS2_F0! %02X\n", code);
                     return -1;
             }
@@ -414,12 +250,12 @@ int8_t process_cs2(uint8_t code)
             switch (code) {
                 case 0x12:  // to be ignored
                 case 0x59:  // to be ignored
-                    state_cs2 = CS2_INIT;
+                    kbd->decode_state = CS2_INIT;
                     break;
                 default:
-                    state_cs2 = CS2_INIT;
+                    kbd->decode_state = CS2_INIT;
                     if (code < 0x80) {
-                        register_code(cs2_to_hid[code | 0x80], false);
+                        key_event(kbd, code | 0x80, false);
                     } else {
                         xprintf("!CS2_E0_F0!\n");
                         return -1;
@@ -430,120 +266,573 @@ int8_t process_cs2(uint8_t code)
         case CS2_E1:
             switch (code) {
                 case 0x14:
-                    state_cs2 = CS2_E1_14;
+                    kbd->decode_state = CS2_E1_14;
                     break;
                 case 0xF0:
-                    state_cs2 = CS2_E1_F0;
+                    kbd->decode_state = CS2_E1_F0;
                     break;
                 default:
-                    state_cs2 = CS2_INIT;
+                    kbd->decode_state = CS2_INIT;
             }
             break;
         case CS2_E1_14:
             switch (code) {
                 case 0x77:
-                    register_code(cs2_to_hid[code | 0x80], true);
-                    state_cs2 = CS2_INIT;
+                    key_event(kbd, code | 0x80, true);
+                    kbd->decode_state = CS2_INIT;
                     break;
                 default:
-                    state_cs2 = CS2_INIT;
+                    kbd->decode_state = CS2_INIT;
             }
             break;
         // Pause break: E1 F0 14 F0 77
         case CS2_E1_F0:
             switch (code) {
                 case 0x14:
-                    state_cs2 = CS2_E1_F0_14;
+                    kbd->decode_state = CS2_E1_F0_14;
                     break;
                 default:
-                    state_cs2 = CS2_INIT;
+                    kbd->decode_state = CS2_INIT;
             }
             break;
         case CS2_E1_F0_14:
             switch (code) {
                 case 0xF0:
-                    state_cs2 = CS2_E1_F0_14_F0;
+                    kbd->decode_state = CS2_E1_F0_14_F0;
                     break;
                 default:
-                    state_cs2 = CS2_INIT;
+                    kbd->decode_state = CS2_INIT;
             }
             break;
         case CS2_E1_F0_14_F0:
             switch (code) {
                 case 0x77:
-                    register_code(cs2_to_hid[code | 0x80], false);
-                    state_cs2 = CS2_INIT;
+                    key_event(kbd, code | 0x80, false);
+                    kbd->decode_state = CS2_INIT;
                     break;
                 default:
-                    state_cs2 = CS2_INIT;
+                    kbd->decode_state = CS2_INIT;
             }
             break;
         default:
-            state_cs2 = CS2_INIT;
+            kbd->decode_state = CS2_INIT;
     }
     return 0;
 }
 
-void ps2_set_led(int8_t led)
+// Code Set 3 -> key position(Code Set 2 code, E0-prefixed: code | 0x80)
+// Set 3 codes are translated into the same positions as Set 2 so that
+// keymaps work for both. Layout of IBM 101/102-key keyboard in Set 3.
+static const uint8_t cs3_to_cs2[0x90] = {
+    //0    1     2     3     4     5     6     7     8     9     A     B     C     D     E     F
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x76, 0x00, 0x00, 0x00, 0x00, 0x0D, 0x0E, 0x06, // 0
+    0x00, 0x14, 0x12, 0x61, 0x58, 0x15, 0x16, 0x04, 0x00, 0x11, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x0C, // 1
+    0x00, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x03, 0x00, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x0B, // 2
+    0x00, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x83, 0x00, 0x91, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x0A, // 3
+    0x00, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x01, 0x00, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x09, // 4
+    0x00, 0x00, 0x52, 0x5D, 0x54, 0x55, 0x78, 0xFC, 0x94, 0x59, 0x5A, 0x5B, 0x5D, 0x00, 0x07, 0x7E, // 5
+    0xF2, 0xEB, 0xF7, 0xF5, 0xF1, 0xE9, 0x66, 0xF0, 0x00, 0x69, 0xF4, 0x6B, 0x6C, 0xFA, 0xEC, 0xFD, // 6
+    0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x77, 0xCA, 0x00, 0xDA, 0x7A, 0x00, 0x79, 0x7D, 0x7C, 0x00, // 7
+    0x00, 0x00, 0x00, 0x00, 0x7B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x9F, 0xA7, 0xAF, 0x00, 0x00, // 8
+};
+
+// All keys are set to make/break with F8 in Code Set 3: no typematic and no prefix
+int8_t process_cs3(keyboard_t *kbd, uint8_t code)
 {
-    ps2_led = led;
+    enum {
+        CS3_INIT,
+        CS3_F0,
+    };
 
+    switch (kbd->decode_state) {
+        case CS3_INIT:
+            switch (code) {
+                case 0xF0:
+                    kbd->decode_state = CS3_F0;
+                    break;
+                case 0x00 ... 0x8F:
+                    if (cs3_to_cs2[code]) key_event(kbd, cs3_to_cs2[code], true);
+                    break;
+                case 0xAA:  // Self-test passed
+                case 0xFC:  // Self-test failed
+                    return -2;
+                default:    // unknown codes
+                    xprintf("!CS3_INIT!\n");
+                    return -1;
+            }
+            break;
+        case CS3_F0:    // Break code
+            kbd->decode_state = CS3_INIT;
+            switch (code) {
+                case 0x00 ... 0x8F:
+                    if (cs3_to_cs2[code]) key_event(kbd, cs3_to_cs2[code], false);
+                    break;
+                default:
+                    xprintf("!CS3_F0! %02X\n", code);
+                    return -1;
+            }
+            break;
+        default:
+            kbd->decode_state = CS3_INIT;
+    }
+    return 0;
+}
+
+// Code in current code set of keyboard for key position(not E0-prefixed),
+// -1 if the key has no such code
+int16_t keyboard_scan_code(keyboard_t *kbd, uint8_t key)
+{
+    if (kbd->code_set != 3) return key;
+    for (uint8_t code = 0; code < sizeof(cs3_to_cs2); code++) {
+        if (key && cs3_to_cs2[code] == key) return code;
+    }
+    return -1;
+}
+
+// returns -1 on unknown code, -2 on BAT(AA/FC) from hot-plugged keyboard
+static int8_t keyboard_decode(keyboard_t *kbd, uint8_t code)
+{
+    if (kbd->code_set == 3) {
+        return process_cs3(kbd, code);
+    } else {
+        return process_cs2(kbd, code);
+    }
+}
+
+// Switch to Code Set 3 if keyboard supports it, otherwise stay in Code Set 2
+static uint8_t keyboard_select_code_set(keyboard_t *kbd)
+{
+    int16_t r;
+    if (ps2_send(kbd, 0xF0) != 0xFA) goto CS2;
+    if (ps2_send(kbd, 0x03) != 0xFA) goto CS2;
+
+    // read back current code set
+    if (ps2_send(kbd, 0xF0) != 0xFA) goto CS2;
+    if (ps2_send(kbd, 0x00) != 0xFA) goto CS2;
+    r = ps2_port_recv_response(&kbd->port);
+    if (r != 0x03) goto CS2;
+
+    // Set All Keys Make/Break
+    if (ps2_send(kbd, 0xF8) != 0xFA) goto CS2;
+    return 3;
+CS2:
+    ps2_send(kbd, 0xF0);
+    ps2_send(kbd, 0x02);
+    return 2;
+}
+
+static void keyboard_set_led(keyboard_t *kbd, int8_t led)
+{
     // keyboard is not ready
-    if (ps2_kbd_id == 0xFFFF) return;
+    if (kbd->id == 0xFFFF) return;
+    // clock is inhibited: set on resume
+    if (kbd->quiesce == QUIESCE_INHIBITED) return;
+    if (kbd->profile->flags & PROFILE_NO_LED) return;
 
     int16_t r;
-    r = ps2_send(0xED);
+    r = ps2_send(kbd, 0xED);
     if (r == 0xFA) {
         wait_us(100);
-        r = ps2_send((uint8_t) led);
+        r = ps2_send(kbd, (uint8_t) led);
     }
 }
 
-void ps2_task(void)
+void ps2_set_led(int8_t led)
 {
-    static uint32_t detect_ms = 0;
-    // keyboard detection
-    if (ps2_kbd_id == 0xFFFF) {
-        if (board_millis() - detect_ms < 1000) return;
-        detect_ms = board_millis();
-
-        int16_t r;
-        r = ps2_send(0xFF);
-        if (r != 0xFA) return;
+    recover_hold(RECOVER_SETUP_MS);
+    ps2_led = led;
+    for (uint8_t i = 0; i < KEYBOARD_COUNT; i++) {
+        keyboard_set_led(&keyboards[i], led);
+    }
+}
 
-        wait_ms(500);
-        r = ps2_send(0xF2);
-        if (r != 0xFA) return;
+// Set up keyboard with its ID
+static void keyboard_setup(keyboard_t *kbd, uint16_t id)
+{
+    recover_hold(RECOVER_SETUP_MS);
+    kbd->detect_state = DETECT_BAT;
+    kbd->profile = profile_lookup(id);
+    printf("ps2_kbd_id[%u]:%04X %s\n", (uint) (kbd - keyboards), id, kbd->profile->name);
+
+    kbd->decode_state = 0;
+    if (kbd->profile->flags & PROFILE_CS3_NATIVE) {
+        ps2_send(kbd, 0xF8);    // Set All Keys Make/Break
+        kbd->code_set = 3;
+    } else if (kbd->profile->flags & PROFILE_CS3) {
+        kbd->code_set = keyboard_select_code_set(kbd);
+    } else {
+        kbd->code_set = 2;
+    }
+    if (kbd->code_set == 2 && (kbd->profile->flags & PROFILE_TYPEMATIC_SLOW)) {
+        // 1000ms delay and 2cps
+        if (ps2_send(kbd, 0xF3) == 0xFA) ps2_send(kbd, 0x7F);
+    }
+    printf("code_set[%u]:%u\n", (uint) (kbd - keyboards), kbd->code_set);
 
-        wait_ms(500);
-        r = ps2_recv();
-        ps2_kbd_id = (uint16_t) ((r & 0xFF) << 8);
+    // keyboard is ready
+    kbd->id = id;
+    boot_mark(BOOT_KEYBOARD_READY);
+    if (ps2_led != -1) {
+        keyboard_set_led(kbd, ps2_led);
+    }
+}
 
-        wait_ms(500);
-        r = ps2_recv();
-        ps2_kbd_id = (uint16_t) ((ps2_kbd_id & 0xFF00) | (r & 0x00FF));
-        printf("ps2_kbd_id:%04X\n",  ps2_kbd_id);
+// Request ID, keyboard is expected to be just after BAT
+static void keyboard_request_id(keyboard_t *kbd)
+{
+    kbd->detect_ms = board_millis();
+    kbd->detect_id = 0;
+    if (ps2_send(kbd, 0xF2) == 0xFA) {
+        kbd->detect_state = DETECT_ID_1;
+    } else {
+        // AT keyboard: no ID
+        keyboard_setup(kbd, 0x0000);
+    }
+}
 
-        if (ps2_led != -1) {
-            ps2_set_led(ps2_led);
-        }
+// Detection runs in steps without blocking so that USB enumeration and other
+// ports go on meanwhile. BAT sent by keyboard at power-on is waited for first,
+// and reset command is used only when it doesn't come.
+static void keyboard_detect(keyboard_t *kbd)
+{
+    int16_t c = ps2_recv(kbd);
+    uint32_t elapsed = board_millis() - kbd->detect_ms;
+    switch (kbd->detect_state) {
+        case DETECT_BAT:
+        case DETECT_RESET:
+            if (c == 0xAA || c == 0xFC) {
+                boot_mark(BOOT_KEYBOARD_BAT);
+                keyboard_request_id(kbd);
+            } else if (elapsed >= DETECT_BAT_WAIT) {
+                if (kbd->detect_state == DETECT_RESET) {
+                    // no BAT after reset command: try ID anyway
+                    keyboard_request_id(kbd);
+                    break;
+                }
+                kbd->detect_ms = board_millis();
+                if (ps2_send(kbd, 0xFF) == 0xFA) {
+                    kbd->stats.resets++;
+                    kbd->detect_state = DETECT_RESET;
+                }
+            }
+            break;
+        case DETECT_ID_1:
+        case DETECT_ID_2:
+            if (c != -1) {
+                capture_record(kbd->port.clock_pin, CAPTURE_RESPONSE, (uint8_t) c);
+                kbd->detect_id = (uint16_t) (kbd->detect_id << 8 | (c & 0xFF));
+                if (kbd->detect_state == DETECT_ID_2) {
+                    keyboard_setup(kbd, kbd->detect_id);
+                } else {
+                    kbd->detect_state = DETECT_ID_2;
+                }
+            } else if (elapsed >= DETECT_ID_WAIT) {
+                // missing ID byte is 00
+                keyboard_setup(kbd, (kbd->detect_state == DETECT_ID_2) ? (uint16_t) (kbd->detect_id << 8) : 0x0000);
+            }
+            break;
+        default:
+            kbd->detect_state = DETECT_BAT;
+            break;
     }
+}
 
-    // keyboard is not ready
-    if (ps2_kbd_id == 0xFFFF) return;
+// keys and layers of lost keyboard are released not to be left stuck
+static void keyboard_lost(keyboard_t *kbd)
+{
+    key_release_all(kbd);
+    if (!event_source) action_clear();
+}
 
-    int16_t c = ps2_recv();
+// reinit keyboard with reset command
+void ps2_redetect(keyboard_t *kbd)
+{
+    keyboard_lost(kbd);
+    kbd->id = 0xFFFF;
+    kbd->detect_state = DETECT_BAT;
+    kbd->detect_ms = board_millis() - DETECT_BAT_WAIT;
+}
+
+static void keyboard_task(keyboard_t *kbd)
+{
+    // keyboard detection
+    if (kbd->id == 0xFFFF) {
+        keyboard_detect(kbd);
+        return;
+    }
+
+    int16_t c = ps2_recv(kbd);
     if (c != -1) {
+        kbd->stats.bytes++;
+        capture_record(kbd->port.clock_pin, CAPTURE_RECV, (uint8_t) c);
+
         // Remote wakeup
         if (tud_suspended()) {
             tud_remote_wakeup();
         }
 
-        int8_t r = process_cs2((uint8_t) c);
+        // bytes are not decoded while suspended, state is cleared on resume
+        if (kbd->quiesce == QUIESCE_WAKE) return;
+
+        uint32_t start = cycles_read();
+        int8_t r = keyboard_decode(kbd, (uint8_t) c);
+        stage_end(STAGE_SCAN, start, (uint8_t) ((kbd->port.rbuf.head - kbd->port.rbuf.tail) & kbd->port.rbuf.size_mask));
         if (r == -1) {
-            ps2_kbd_id = 0xFFFF; // reinit keyboard
+            kbd->stats.unknown++;
+            ps2_redetect(kbd);
+        } else if (r == -2) {
+            // hot-plugged: keyboard has done reset by itself
+            printf("hotplug[%u]:%02X\n", (uint) (kbd - keyboards), c);
+            kbd->stats.hotplugs++;
+            keyboard_lost(kbd);
+            kbd->id = 0xFFFF;
+            keyboard_request_id(kbd);
+        }
+    }
+}
+
+// Replay of captured bytes through decoder with HID output muted.
+// Fast replay decodes all at once to measure throughput, timed replay
+// keeps original intervals so that tap keys and timeouts work the same.
+// Hash of resulting reports can be compared between firmware versions.
+// Replay has its own keyboard state and shares the pipeline after decoder:
+// keys of live keyboards are released at start and their events are ignored
+// until the end, while their ports are still serviced.
+static struct {
+    bool active;
+    uint8_t pin;
+    uint16_t index;
+    uint32_t start;
+    uint32_t t0;
+    uint32_t bytes;
+    bool capture;
+    keyboard_t kbd;
+} replay;
+
+void hid_mute(bool on);
+uint32_t hid_hash(void);
+uint32_t hid_hash_count(void);
+
+static bool replay_next(bool timed)
+{
+    const capture_t *e;
+    while ((e = capture_get(replay.index)) != NULL) {
+        if (e->pin != replay.pin || e->type != CAPTURE_RECV) {
+            replay.index++;
+            continue;
+        }
+        if (replay.bytes == 0) replay.t0 = e->time;
+        if (timed && time_us_32() - replay.start < e->time - replay.t0) return true;
+        replay.index++;
+        replay.bytes++;
+        if (keyboard_decode(&replay.kbd, e->data) < 0) {
+            // same as keyboard_task
+            key_release_all(&replay.kbd);
+        }
+        return true;
+    }
+    return false;
+}
+
+// release everything on the pipeline shared with replay
+static void replay_release(keyboard_t *kbd)
+{
+    key_release_all(kbd);
+    action_clear();
+    pipeline_task();
+}
+
+static void replay_finish(void)
+{
+    replay_release(&replay.kbd);
+    uint32_t us = time_us_32() - replay.start;
+    printf("\nreplay: bytes:%lu events:%lu reports:%lu hash:%08lX time:%luus",
+            (unsigned long) replay.bytes,
+            (unsigned long) replay.kbd.stats.events,
+            (unsigned long) hid_hash_count(),
+            (unsigned long) hid_hash(),
+            (unsigned long) us);
+    if (us) printf(" %lubytes/s", (unsigned long) ((uint64_t) replay.bytes * 1000000 / us));
+    printf("\n");
+    hid_mute(false);
+    capture_enabled = replay.capture;
+    replay.active = false;
+    event_source = NULL;
+}
+
+void ps2_replay(bool timed)
+{
+    if (replay.active) replay_finish();
+
+    // replay the first keyboard port
+    keyboard_t *kbd = &keyboards[0];
+
+    memset(&replay, 0, sizeof(replay));
+    replay.pin = kbd->port.clock_pin;
+    replay.kbd.code_set = kbd->code_set;
+    replay.kbd.id = kbd->id;
+    replay.kbd.profile = kbd->profile;
+
+    // live keys are released to host before muted
+    for (uint8_t i = 0; i < KEYBOARD_COUNT; i++) {
+        replay_release(&keyboards[i]);
+    }
+    event_source = &replay.kbd;
+
+    // don't record replay itself
+    replay.capture = capture_enabled;
+    capture_enabled = false;
+    hid_mute(true);
+    replay.start = time_us_32();
+    if (timed) {
+        replay.active = true;
+        return;
+    }
+    while (replay_next(false)) ;
+    replay_finish();
+}
+
+// Keyboards are quiesced while USB is suspended or unmounted. With remote
+// wakeup enabled keyboard keeps scanning for a key to wake up host, otherwise
+// scanning is disabled with F5 or clock is inhibited for keyboard which
+// doesn't take it. Mode is requested from USB callbacks and changed here
+// since it takes PS/2 commands.
+static volatile uint8_t quiesce_request = QUIESCE_NONE;
+static uint8_t quiesce_mode = QUIESCE_NONE;
+
+static void keyboard_quiesce(keyboard_t *kbd, uint8_t mode)
+{
+    // break of keys held won't come
+    key_release_all(kbd);
+
+    if (kbd->id != 0xFFFF) {
+        if (mode == QUIESCE_WAKE) {
+            kbd->quiesce = QUIESCE_WAKE;
+            return;
+        }
+        if (ps2_send(kbd, 0xF5) == 0xFA) {
+            kbd->quiesce = QUIESCE_DISABLED;
+            return;
         }
     }
+    ps2_port_inhibit(&kbd->port);
+    kbd->quiesce = QUIESCE_INHIBITED;
+}
+
+static void keyboard_resume(keyboard_t *kbd)
+{
+    uint8_t quiesce = kbd->quiesce;
+    kbd->quiesce = QUIESCE_NONE;
+
+    switch (quiesce) {
+        case QUIESCE_DISABLED:
+            // F5 restores defaults on some keyboards: set up again with LEDs
+            if (ps2_send(kbd, 0xF4) != 0xFA) {
+                ps2_redetect(kbd);
+                return;
+            }
+            keyboard_setup(kbd, kbd->id);
+            return;
+        case QUIESCE_INHIBITED:
+            ps2_port_idle(&kbd->port);
+            if (kbd->id == 0xFFFF) {
+                ps2_redetect(kbd);
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+    key_release_all(kbd);
+    if (ps2_led != -1) {
+        keyboard_set_led(kbd, ps2_led);
+    }
+}
+
+static void quiesce_task(void)
+{
+    uint8_t mode = quiesce_request;
+    if (mode == quiesce_mode) return;
+
+    recover_hold(RECOVER_SETUP_MS);
+    for (uint8_t i = 0; i < KEYBOARD_COUNT; i++) {
+        keyboard_t *kbd = &keyboards[i];
+        if (kbd->quiesce != QUIESCE_NONE) keyboard_resume(kbd);
+        if (mode != QUIESCE_NONE) keyboard_quiesce(kbd, mode);
+    }
+    quiesce_mode = mode;
+    printf("quiesce:%u\n", mode);
+}
+
+bool ps2_quiesced(void)
+{
+    return quiesce_mode != QUIESCE_NONE;
+}
+
+void ps2_task(void)
+{
+    if (replay.active) {
+        if (!replay_next(true)) {
+            replay_finish();
+        }
+    }
+
+    quiesce_task();
+    for (uint8_t i = 0; i < KEYBOARD_COUNT; i++) {
+        keyboard_t *kbd = &keyboards[i];
+        if (kbd->quiesce == QUIESCE_DISABLED || kbd->quiesce == QUIESCE_INHIBITED) continue;
+        keyboard_task(kbd);
+    }
+}
+
+// Keyboard kept its settings across watchdog reboot: ready without detection
+static void keyboard_restore(keyboard_t *kbd, const recover_keyboard_t *saved)
+{
+    kbd->profile = profile_lookup(saved->id);
+    kbd->detect_state = DETECT_BAT;
+    kbd->code_set = saved->code_set;
+    kbd->decode_state = 0;
+    kbd->stats = saved->stats;
+    kbd->id = saved->id;
+    boot_mark(BOOT_KEYBOARD_READY);
+
+    // scanning was disabled or clock inhibited when reboot happened
+    kbd->quiesce = saved->quiesce;
+    if (kbd->quiesce != QUIESCE_NONE) keyboard_resume(kbd);
+}
+
+void ps2_init(void)
+{
+    const recover_state_t *saved = recover_state();
+    for (uint8_t i = 0; i < KEYBOARD_COUNT; i++) {
+        keyboards[i].id = 0xFFFF;
+        ps2_port_init(&keyboards[i].port);
+        if (saved && i < RECOVER_KEYBOARDS && saved->keyboards[i].id != 0xFFFF) {
+            keyboard_restore(&keyboards[i], &saved->keyboards[i]);
+        }
+    }
+}
+
+keyboard_t *ps2_keyboard(uint8_t i)
+{
+    return (i < KEYBOARD_COUNT) ? &keyboards[i] : NULL;
+}
+
+void ps2_print_stats(void)
+{
+    for (uint8_t i = 0; i < KEYBOARD_COUNT; i++) {
+        keyboard_t *kbd = &keyboards[i];
+        printf("kbd[%u] pin:%u/%u id:%04X(%s) set:%u quiesce:%u bytes:%lu events:%lu errors:%lu unknown:%lu resets:%lu hotplugs:%lu\n",
+                i, kbd->port.clock_pin, kbd->port.data_pin, kbd->id,
+                kbd->profile ? kbd->profile->name : "-", kbd->code_set, kbd->quiesce,
+                (unsigned long) kbd->stats.bytes,
+                (unsigned long) kbd->stats.events,
+                (unsigned long) kbd->stats.errors,
+                (unsigned long) kbd->stats.unknown,
+                (unsigned long) kbd->stats.resets,
+                (unsigned long) kbd->stats.hotplugs);
+        ps2_port_print_timing(&kbd->port);
+    }
 }
 
 
@@ -577,19 +866,52 @@ void ps2_task(void)
  *
  */
 void led_blinking_task(void);
+void hid_task(void);
+static void keyboard_xfer_reset(void);
 
 int main() {
+    boot_mark(BOOT_MAIN);
     board_init();
+    boot_mark(BOOT_BOARD);
+    // cycle counter is used by PS/2 port from ps2_init(): commands on restore
+    cycles_init();
+
+    // state saved before watchdog reboot, if any
+    recover_init();
+
+    // start receiving early not to miss BAT of keyboard at power-on
+    ps2_init();
+    ps2_mouse_init();
+    boot_mark(BOOT_PS2);
+
+    // USB enumeration goes on in tud_task() while keyboard is detected
     tud_init(BOARD_TUD_RHPORT);
+    sof_init();
+    boot_mark(BOOT_USB);
     stdio_init_all();
+    boot_mark(BOOT_STDIO);
 
-    ps2_init();
+    bench_init();
 
     printf("\ntinyusb_ps2\n");
     while (true) {
+        recover_task();
+        bench_task();
         ps2_task();
+        action_task();
+        pipeline_task();
+        ps2_mouse_task();
         tud_task();
+        hid_task();
+        command_task();
+        raw_task();
+        logic_task();
         led_blinking_task();
+
+        // sleep until interrupt of PS/2, USB resume or timeout for blink
+        if (ps2_quiesced()) {
+            best_effort_wfe_or_timeout(make_timeout_time_ms(QUIESCE_SLEEP_MS));
+        }
     }
     return 0;
 }
@@ -611,6 +933,43 @@ enum  {
 };
 
 static uint32_t blink_interval_ms = BLINK_NOT_MOUNTED;
+
+//--------------------------------------------------------------------+
+// Device callbacks
+//--------------------------------------------------------------------+
+
+// Invoked when device is mounted
+void tud_mount_cb(void)
+{
+  blink_interval_ms = BLINK_MOUNTED;
+  boot_mark(BOOT_MOUNTED);
+  keyboard_xfer_reset();
+  quiesce_request = QUIESCE_NONE;
+}
+
+// Invoked when device is unmounted
+void tud_umount_cb(void)
+{
+  blink_interval_ms = BLINK_NOT_MOUNTED;
+  keyboard_xfer_reset();
+  quiesce_request = QUIESCE_OFF;
+}
+
+// Invoked when usb bus is suspended
+// remote_wakeup_en : if host allow us  to perform remote wakeup
+// Within 7ms, device must draw an average of current less than 2.5 mA from bus
+void tud_suspend_cb(bool remote_wakeup_en)
+{
+  blink_interval_ms = BLINK_SUSPENDED;
+  quiesce_request = remote_wakeup_en ? QUIESCE_WAKE : QUIESCE_OFF;
+}
+
+// Invoked when usb bus is resumed
+void tud_resume_cb(void)
+{
+  blink_interval_ms = tud_mounted() ? BLINK_MOUNTED : BLINK_NOT_MOUNTED;
+  quiesce_request = QUIESCE_NONE;
+}
 void led_blinking_task(void)
 {
   static uint32_t start_ms = 0;
@@ -654,63 +1013,348 @@ typedef union {
 //
 // codes from TMK <<<
 //
+_Static_assert(sizeof(report_keyboard_t) == KEYBOARD_REPORT_SIZE, "Keyboard report size mismatch");
 
 static report_keyboard_t keyboard_report;
 
-void keyboard_add_key(uint8_t key)
+// Keyboard reports are queued and sent one per USB frame so that changes in
+// a frame(tap key and macro) are not lost while the endpoint is busy.
+// When queue is full the latest entry is overwritten with current report.
+//
+// Entry at tail is the endpoint buffer while in flight: it is passed to
+// endpoint without copy and dequeued on completion, so it is never changed
+// during transfer. Overwrite never hits it as the queue holds more than two.
+// Each entry is padded to alignment required for endpoint buffer.
+#define KEYBOARD_QUEUE_SIZE 8
+typedef struct {
+    report_keyboard_t report;
+} CFG_TUSB_MEM_ALIGN keyboard_queue_entry_t;
+
+CFG_TUSB_MEM_SECTION
+static keyboard_queue_entry_t keyboard_queue[KEYBOARD_QUEUE_SIZE];
+static uint8_t keyboard_queue_head = 0;
+static uint8_t keyboard_queue_tail = 0;
+static bool keyboard_inflight = false;
+
+// usage events not yet in report are also counted
+bool keyboard_queue_empty(void)
+{
+    return keyboard_queue_head == keyboard_queue_tail && usage_events.head == usage_events.tail;
+}
+
+// keyboard and usage queues together
+static hid_queue_stats_t queue_stats;
+
+const hid_queue_stats_t *hid_get_queue_stats(void)
+{
+    return &queue_stats;
+}
+
+void hid_clear_queue_stats(void)
+{
+    memset(&queue_stats, 0, sizeof(queue_stats));
+}
+
+static void queue_stats_update(uint8_t depth, bool overwrite)
+{
+    queue_stats.reports++;
+    if (overwrite) queue_stats.overwrites++;
+    if (depth > queue_stats.max_depth) queue_stats.max_depth = depth;
+}
+
+// Reports are dropped at 1ms interval without sending, for benchmark
+static bool sink = false;
+static uint32_t sink_ms;
+
+void hid_sink(bool on)
+{
+    sink = on;
+}
+
+void hid_task(void);
+
+// Reports are not sent while muted, their hash is calculated instead(FNV-1a)
+static bool muted = false;
+static uint32_t muted_hash;
+static uint32_t muted_count;
+
+void hid_mute(bool on)
+{
+    muted = on;
+    muted_hash = 2166136261u;
+    muted_count = 0;
+}
+
+uint32_t hid_hash(void)
+{
+    return muted_hash;
+}
+
+uint32_t hid_hash_count(void)
+{
+    return muted_count;
+}
+
+static void hid_hash_report(uint8_t id, const void *report, uint16_t len)
+{
+    const uint8_t *p = report;
+    muted_hash = (muted_hash ^ id) * 16777619u;
+    while (len--) {
+        muted_hash = (muted_hash ^ *p++) * 16777619u;
+    }
+    muted_count++;
+}
+
+// Consumer/System Control: set of usages pressed currently
+typedef struct {
+    uint16_t usage[USAGE_REPORT_COUNT];
+} __attribute__ ((packed)) report_usage_t;
+_Static_assert(sizeof(report_usage_t) == USAGE_REPORT_SIZE, "Usage report size mismatch");
+
+// Changes of the set are queued per report ID. Consecutive presses not sent
+// yet are coalesced into one report, while release always gets its own so
+// that short press is not lost within polling interval of HID interface.
+#define USAGE_QUEUE_SIZE    4
+typedef struct {
+    report_usage_t report;
+    report_usage_t queue[USAGE_QUEUE_SIZE];
+    uint8_t head;
+    uint8_t tail;
+    bool coalesce;      // the latest in queue is press and not sent yet
+    uint8_t report_id;
+} usage_queue_t;
+
+static usage_queue_t usage_queues[2] = {
+    { .report_id = REPORT_ID_CONSUMER_CONTROL },
+    { .report_id = REPORT_ID_SYSTEM_CONTROL },
+};
+
+static void usage_report_update(usage_queue_t *q, uint16_t usage, bool make)
+{
+    if (usage == 0) return;
+
+    int8_t found = -1, empty = -1;
+    for (int8_t i = 0; i < USAGE_REPORT_COUNT; i++) {
+        if (q->report.usage[i] == usage) found = i;
+        if (empty == -1 && q->report.usage[i] == 0) empty = i;
+    }
+    if (make) {
+        if (found != -1 || empty == -1) return;   // no change or rollover
+        q->report.usage[empty] = usage;
+    } else {
+        if (found == -1) return;                    // no change
+        q->report.usage[found] = 0;
+    }
+
+    if (muted) {
+        hid_hash_report(q->report_id, &q->report, sizeof(report_usage_t));
+        return;
+    }
+
+    uint8_t latest = (q->head - 1) & (USAGE_QUEUE_SIZE - 1);
+    uint8_t next = (q->head + 1) & (USAGE_QUEUE_SIZE - 1);
+    if ((make && q->coalesce) || next == q->tail) {
+        q->queue[latest] = q->report;
+        queue_stats_update((q->head - q->tail) & (USAGE_QUEUE_SIZE - 1), !(make && q->coalesce));
+    } else {
+        q->queue[q->head] = q->report;
+        q->head = next;
+        queue_stats_update((q->head - q->tail) & (USAGE_QUEUE_SIZE - 1), false);
+    }
+    q->coalesce = make;
+}
+
+// Report is handed to endpoint directly instead of tud_hid_n_report() which
+// copies it into buffer of HID class driver. Completion is still notified
+// with tud_hid_report_complete_cb().
+static bool keyboard_xfer(report_keyboard_t *report, uint16_t len)
+{
+    if (!usbd_edpt_claim(BOARD_TUD_RHPORT, EPNUM_KEYBOARD)) return false;
+    if (!usbd_edpt_xfer(BOARD_TUD_RHPORT, EPNUM_KEYBOARD, (uint8_t *) report, len)) {
+        usbd_edpt_release(BOARD_TUD_RHPORT, EPNUM_KEYBOARD);
+        return false;
+    }
+    return true;
+}
+
+// transfer in flight is aborted by bus reset
+static void keyboard_xfer_reset(void)
+{
+    keyboard_inflight = false;
+}
+
+// Transfer ended without completion: endpoint was closed or reset under it.
+// Entry at tail is still queued and sent again.
+static void keyboard_xfer_check(void)
+{
+    if (keyboard_inflight && !usbd_edpt_busy(BOARD_TUD_RHPORT, EPNUM_KEYBOARD)) {
+        keyboard_inflight = false;
+    }
+}
+
+// reports ready to be submitted
+static bool usb_pending(void)
+{
+    if (usage_queues[0].head != usage_queues[0].tail || usage_queues[1].head != usage_queues[1].tail) return true;
+    return keyboard_queue_head != keyboard_queue_tail && !keyboard_inflight;
+}
+
+static void usb_stage(void)
+{
+    // sink: one report per interface every millisecond like 1ms polling
+    bool sink_ready = false;
+    if (sink && board_millis() != sink_ms) {
+        sink_ms = board_millis();
+        sink_ready = true;
+    }
+
+    if (!sink) keyboard_xfer_check();
+
+    // hold reports until just before IN token
+    if (!sink && sof_align && usb_pending() && !sof_commit_window()) return;
+
+    if (sink ? sink_ready : tud_hid_n_ready(ITF_NUM_HID)) {
+        for (uint8_t i = 0; i < 2; i++) {
+            usage_queue_t *q = &usage_queues[i];
+            if (q->head == q->tail) continue;
+            if (!sink) tud_hid_n_report(ITF_NUM_HID, q->report_id, &q->queue[q->tail], sizeof(report_usage_t));
+            q->tail = (q->tail + 1) & (USAGE_QUEUE_SIZE - 1);
+            if (q->head == q->tail) q->coalesce = false;
+            break;
+        }
+    }
+
+    if (keyboard_queue_empty() || keyboard_inflight) return;
+    if (!(sink ? sink_ready : tud_hid_n_ready(ITF_NUM_KEYBOARD))) return;
+
+    if (sink) {
+        // dropped
+        keyboard_queue_tail = (keyboard_queue_tail + 1) & (KEYBOARD_QUEUE_SIZE - 1);
+        return;
+    }
+    uint16_t len = (tud_hid_n_get_protocol(ITF_NUM_KEYBOARD) == HID_PROTOCOL_BOOT) ?
+                   KEYBOARD_BOOT_SIZE : sizeof(report_keyboard_t);
+    keyboard_inflight = true;
+    if (!keyboard_xfer(&keyboard_queue[keyboard_queue_tail].report, len)) {
+        keyboard_inflight = false;
+    }
+}
+
+void hid_task(void)
+{
+    uint8_t depth = (keyboard_queue_head - keyboard_queue_tail) & (KEYBOARD_QUEUE_SIZE - 1);
+    uint32_t start = cycles_read();
+    usb_stage();
+    stage_end(STAGE_USB, start, depth);
+}
+
+static void keyboard_send(void)
+{
+    if (muted) {
+        hid_hash_report(0, &keyboard_report, sizeof(keyboard_report));
+        return;
+    }
+
+    uint8_t next = (keyboard_queue_head + 1) & (KEYBOARD_QUEUE_SIZE - 1);
+    if (next == keyboard_queue_tail) {
+        // full: overwrite the latest
+        keyboard_queue[(keyboard_queue_head - 1) & (KEYBOARD_QUEUE_SIZE - 1)].report = keyboard_report;
+        queue_stats_update(KEYBOARD_QUEUE_SIZE - 1, true);
+    } else {
+        keyboard_queue[keyboard_queue_head].report = keyboard_report;
+        keyboard_queue_head = next;
+        queue_stats_update((keyboard_queue_head - keyboard_queue_tail) & (KEYBOARD_QUEUE_SIZE - 1), false);
+    }
+}
+
+static void report_add_key(report_keyboard_t *report, uint8_t key, bool nkro)
 {
     if (key >= 0xE0 && key <= 0xE8) {
-        keyboard_report.mods |= (uint8_t) (1 << (key & 0x7));
+        report->mods |= (uint8_t) (1 << (key & 0x7));
         return;
     }
 
     // NKRO
-    if (tud_hid_n_get_protocol(ITF_NUM_KEYBOARD) == HID_PROTOCOL_REPORT) {
+    if (nkro) {
         if ((key >> 3) < KEYBOARD_REPORT_BITS) {
-            keyboard_report.nkro.bits[key >> 3] |= (uint8_t) (1 << (key  & 0x7));
+            report->nkro.bits[key >> 3] |= (uint8_t) (1 << (key  & 0x7));
         }
         return;
     }
 
     // 6KRO
     int empty = -1;
-    for (int i = 0; i < 6; i++) {
-        if (keyboard_report.keys[i] == key) {
+    for (int i = 0; i < KEYBOARD_BOOT_KEYS; i++) {
+        if (report->keys[i] == key) {
             return;
         }
-        if (empty == -1 && keyboard_report.keys[i] == 0) {
+        if (empty == -1 && report->keys[i] == 0) {
             empty = i;
         }
     }
     if (empty != -1) {
-        keyboard_report.keys[empty] = key;
+        report->keys[empty] = key;
     }
 }
 
-void keyboard_del_key(uint8_t key)
+static void report_del_key(report_keyboard_t *report, uint8_t key, bool nkro)
 {
     if (key >= 0xE0 && key <= 0xE8) {
-        keyboard_report.mods &= (uint8_t) ~(1 << (key & 0x7));
+        report->mods &= (uint8_t) ~(1 << (key & 0x7));
         return;
     }
 
     // NKRO
-    if (tud_hid_n_get_protocol(ITF_NUM_KEYBOARD) == HID_PROTOCOL_REPORT) {
+    if (nkro) {
         if ((key >> 3) < KEYBOARD_REPORT_BITS) {
-            keyboard_report.nkro.bits[key >> 3] &= (uint8_t) ~(1<<(key & 0x7));
+            report->nkro.bits[key >> 3] &= (uint8_t) ~(1<<(key & 0x7));
         }
         return;
     }
 
     // 6KRO
-    for (int i = 0; i < 6; i++) {
-        if (keyboard_report.keys[i] == key) {
-            keyboard_report.keys[i] = 0;
+    for (int i = 0; i < KEYBOARD_BOOT_KEYS; i++) {
+        if (report->keys[i] == key) {
+            report->keys[i] = 0;
             return;
         }
     }
 }
 
+// usage is pressed in report as sent: boot or NKRO by its length
+bool keyboard_report_has(const uint8_t *report, uint16_t len, uint8_t usage)
+{
+    if (!len) return false;
+    if (usage >= 0xE0 && usage <= 0xE7) {
+        return report[0] & (1 << (usage & 0x7));
+    }
+
+    // NKRO
+    if (len > KEYBOARD_BOOT_SIZE) {
+        uint16_t i = 1 + (usage >> 3);
+        return i < len && (report[i] & (1 << (usage & 0x7)));
+    }
+
+    // 6KRO
+    for (uint16_t i = 2; i < len; i++) {
+        if (report[i] == usage) return true;
+    }
+    return false;
+}
+
+void keyboard_add_key(uint8_t key)
+{
+    report_add_key(&keyboard_report, key, tud_hid_n_get_protocol(ITF_NUM_KEYBOARD) == HID_PROTOCOL_REPORT);
+}
+
+void keyboard_del_key(uint8_t key)
+{
+    report_del_key(&keyboard_report, key, tud_hid_n_get_protocol(ITF_NUM_KEYBOARD) == HID_PROTOCOL_REPORT);
+}
+
+// reports are printed on console after each update, off in microbenchmarks
+static bool report_print = true;
+
 void print_report(void)
 {
     printf("\n");
@@ -721,7 +1365,13 @@ void print_report(void)
     printf("\n");
 }
 
+// Usage events from actions are queued for report stage
 void register_code(uint16_t code, bool make)
+{
+    event_queue_put(&usage_events, report_stage, code, make);
+}
+
+static void report_update(uint16_t code, bool make)
 {
     // usage page
     uint8_t page = (uint8_t) ((code & 0xf000) >> 12);
@@ -735,23 +1385,11 @@ void register_code(uint16_t code, bool make)
                 } else {
                     keyboard_del_key(key);
                 }
-                if (tud_hid_n_get_protocol(ITF_NUM_KEYBOARD) == HID_PROTOCOL_BOOT) {
-                    tud_hid_n_report(ITF_NUM_KEYBOARD, 0, &keyboard_report, 8);
-                } else { // NKRO
-                    tud_hid_n_report(ITF_NUM_KEYBOARD, 0, &keyboard_report, sizeof(keyboard_report));
-                }
+                keyboard_send();
             }
             break;
         case 0xC: // consumer page
-            {
-                uint16_t usage;
-                if (make) {
-                    usage = code & 0xFFF;
-                } else {
-                    usage = 0;
-                }
-                tud_hid_n_report(ITF_NUM_HID, REPORT_ID_CONSUMER_CONTROL, &usage, sizeof(usage));
-            }
+            usage_report_update(&usage_queues[0], code & 0xFFF, make);
             break;
         case 0x1: // system page
             {
@@ -761,44 +1399,281 @@ void register_code(uint16_t code, bool make)
                     usage != HID_USAGE_DESKTOP_SYSTEM_WAKE_UP) {
                     return;
                 }
-
-                uint8_t report;
-                if (make) {
-                    report = usage & 0x3;
-                } else {
-                    report = 0;
-                }
-                tud_hid_n_report(ITF_NUM_HID, REPORT_ID_SYSTEM_CONTROL, &report, sizeof(report));
+                usage_report_update(&usage_queues[1], usage, make);
             }
             break;
         default:
             break;
     }
-    print_report();
+    if (report_print) print_report();
 }
 
+// key events -> actions
+static bool map_stage(void)
+{
+    event_t e;
+    uint8_t depth = event_queue_depth(&key_events);
+    uint32_t start = cycles_read();
+    if (!event_queue_get(&key_events, &e)) return false;
+    action_exec((uint8_t) e.code, e.make);
+    stage_end(STAGE_MAP, start, depth);
+    return true;
+}
+
+// usage events -> reports
+static bool report_stage(void)
+{
+    event_t e;
+    uint8_t depth = event_queue_depth(&usage_events);
+    uint32_t start = cycles_read();
+    if (!event_queue_get(&usage_events, &e)) return false;
+    report_update(e.code, e.make);
+    stage_end(STAGE_REPORT, start, depth);
+    return true;
+}
+
+// run stages after scan until their queues are empty
+void pipeline_task(void)
+{
+    uint8_t key;
+    bool make;
+    while (chatter_settle(&key, &make)) event_queue_put(&key_events, map_stage, key, make);
+
+    while (map_stage()) ;
+    while (report_stage()) ;
+}
+
+void stage_print(void)
+{
+    static const char * const names[STAGE_COUNT] = { "line", "scan", "map", "report", "usb" };
+    for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+        stage_t *st = &stages[i];
+        printf("%-6s count:%lu max:%lucyc avg:%lucyc depth_max:%u\n", names[i],
+                (unsigned long) st->count,
+                (unsigned long) st->cycles_max,
+                (unsigned long) (st->count ? st->cycles_total / st->count : 0),
+                st->depth_max);
+    }
+}
+
+void stage_clear(void)
+{
+    memset(stages, 0, sizeof(stages));
+}
+
+
+//--------------------------------------------------------------------+
+// Microbenchmarks
+//--------------------------------------------------------------------+
+// Hot paths are measured natively in host build with 'ps2host -b', one line each:
+//   mb: <name> ops=<n> ns/op=<n.n> ops/s=<n>
+// tools/mbcmp.py compares the output with baseline and flags regressions.
+//
+// Benchmarks run in their own process before firmware main loop is started,
+// so key counts, chatter filter and reports they update are not shared with
+// any live keyboard.
+#if MICROBENCH_ENABLE
+#define MB_ROUNDS   1000    // fastest pass is taken, others are disturbed by host
+
+// realistic: 'He lo' with shift, Up, at most 15 key events per pass
+static const uint8_t mb_typing[] = {
+    0x12, 0x33, 0xF0, 0x33, 0xF0, 0x12, 0x24, 0xF0, 0x24, 0x4B, 0xF0, 0x4B,
+    0x44, 0xF0, 0x44, 0x29, 0xF0, 0x29, 0xE0, 0x75, 0xE0, 0xF0, 0x75,
+};
+
+// adversarial: Pause, PrintScreen with fake shifts, typematic repeats, E0 keys
+static const uint8_t mb_adversarial[] = {
+    0xE1, 0x14, 0x77, 0xE1, 0xF0, 0x14, 0xF0, 0x77,
+    0xE0, 0x12, 0xE0, 0x7C, 0xE0, 0xF0, 0x7C, 0xE0, 0xF0, 0x12,
+    0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0xF0, 0x1C,
+    0xE0, 0x4A, 0xE0, 0xF0, 0x4A,
+};
+
+// results are stored here not to be optimized out
+static volatile uint32_t mb_sink;
+
+static void mb_print(const char *name, uint32_t ops, uint32_t cycles)
+{
+    uint64_t mhz = clock_get_hz(clk_sys) / 1000000;
+    uint32_t ns10 = (uint32_t) ((uint64_t) cycles * 10000 / mhz / ops);
+    printf("mb: %s ops=%lu ns/op=%lu.%lu ops/s=%lu\n", name, (unsigned long) ops,
+            (unsigned long) (ns10 / 10), (unsigned long) (ns10 % 10),
+            (unsigned long) ((uint64_t) ops * mhz * 1000000 / (cycles ? cycles : 1)));
+}
+
+static void mb_ringbuf(void)
+{
+    static uint8_t buf[16];
+    static ringbuf_t rb;
+    ringbuf_init(&rb, buf, sizeof(buf));
+    uint32_t best = CYCLES_MASK;
+    uint32_t sum = 0;
+    for (uint16_t r = 0; r < MB_ROUNDS; r++) {
+        uint32_t start = cycles_read();
+        for (uint8_t i = 0; i < 15; i++) ringbuf_put(&rb, i);
+        for (uint8_t i = 0; i < 15; i++) sum += (uint8_t) ringbuf_get(&rb);
+        uint32_t cycles = cycles_since(start);
+        if (cycles < best) best = cycles;
+    }
+    mb_sink = sum;
+    mb_print("ringbuf_put_get", 15, best);
+}
+
+// decoder only: key events are discarded after each pass
+static void mb_cs2(const char *name, const uint8_t *data, uint16_t len)
+{
+    static keyboard_t kbd;
+    memset(&kbd, 0, sizeof(kbd));
+    kbd.code_set = 2;
+    uint32_t best = CYCLES_MASK;
+    for (uint16_t r = 0; r < MB_ROUNDS; r++) {
+        uint32_t start = cycles_read();
+        for (uint16_t i = 0; i < len; i++) process_cs2(&kbd, data[i]);
+        uint32_t cycles = cycles_since(start);
+        if (cycles < best) best = cycles;
+        key_events.tail = key_events.head;
+    }
+    mb_print(name, len, best);
+}
+
+static void mb_report(const char *name, bool nkro)
+{
+    static report_keyboard_t report;
+    static const uint8_t keys[] = { 0xE1, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A };
+    memset(&report, 0, sizeof(report));
+    uint32_t best = CYCLES_MASK;
+    for (uint16_t r = 0; r < MB_ROUNDS; r++) {
+        uint32_t start = cycles_read();
+        for (uint8_t i = 0; i < sizeof(keys); i++) report_add_key(&report, keys[i], nkro);
+        for (uint8_t i = 0; i < sizeof(keys); i++) report_del_key(&report, keys[i], nkro);
+        uint32_t cycles = cycles_since(start);
+        if (cycles < best) best = cycles;
+    }
+    mb_sink = report.raw[0];
+    mb_print(name, 2 * sizeof(keys), best);
+}
+
+// decoder, actions and report building with HID muted, per key event
+static void mb_full(const char *name, const uint8_t *data, uint16_t len)
+{
+    static keyboard_t kbd;
+    memset(&kbd, 0, sizeof(kbd));
+    kbd.code_set = 2;
+    report_print = false;
+    hid_mute(true);
+    uint32_t best = CYCLES_MASK;
+    for (uint16_t r = 0; r < MB_ROUNDS; r++) {
+        uint32_t start = cycles_read();
+        for (uint16_t i = 0; i < len; i++) process_cs2(&kbd, data[i]);
+        pipeline_task();
+        uint32_t cycles = cycles_since(start);
+        if (cycles < best) best = cycles;
+    }
+    hid_mute(false);
+    report_print = true;
+    mb_print(name, kbd.stats.events / MB_ROUNDS, best);
+}
+
+void ps2_microbench(void)
+{
+    bool capture = capture_enabled;
+    capture_enabled = false;
+    mb_ringbuf();
+    mb_cs2("cs2_typing", mb_typing, sizeof(mb_typing));
+    mb_cs2("cs2_adversarial", mb_adversarial, sizeof(mb_adversarial));
+    mb_report("report_boot", false);
+    mb_report("report_nkro", true);
+    mb_full("full_typing", mb_typing, sizeof(mb_typing));
+    mb_full("full_adversarial", mb_adversarial, sizeof(mb_adversarial));
+    capture_enabled = capture;
+}
+#endif
+
 // Invoked when received GET_REPORT control request
 // Application must fill buffer report's content and return its length.
 // Return zero will cause the stack to STALL request
-// Invoked when received GET_REPORT control request
-// Application must fill buffer report's content and return its length.
-// Return zero will cause the stack to STALL request
+//
+// Current state is returned from live reports, which are always up to date
+// with key state, so that host polling on control pipe(KVM, BIOS after
+// resume) gets the same as the next interrupt IN report.
 uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t* buffer, uint16_t reqlen)
 {
-  // TODO not Implemented
-  (void) instance;
-  (void) report_id;
-  (void) report_type;
-  (void) buffer;
-  (void) reqlen;
+#if RAW_ENABLE
+  if (instance == ITF_NUM_RAW && report_type == HID_REPORT_TYPE_FEATURE) return raw_probe_get(buffer, reqlen);
+#endif
+  if (report_type != HID_REPORT_TYPE_INPUT) return 0;
+
+  void const *report = NULL;
+  uint16_t len = 0;
+  hid_mouse_report_t mouse_report;
+
+  if (instance == ITF_NUM_KEYBOARD)
+  {
+    report = &keyboard_report;
+    len = (tud_hid_n_get_protocol(ITF_NUM_KEYBOARD) == HID_PROTOCOL_BOOT) ? KEYBOARD_BOOT_SIZE : sizeof(keyboard_report);
+  }
+  else if (instance == ITF_NUM_HID)
+  {
+    switch (report_id)
+    {
+      case REPORT_ID_MOUSE:
+        // buttons only, movement is reported on interrupt IN
+        memset(&mouse_report, 0, sizeof(mouse_report));
+        mouse_report.buttons = ps2_mouse_buttons();
+        report = &mouse_report;
+        len = sizeof(mouse_report);
+        break;
+      case REPORT_ID_CONSUMER_CONTROL:
+        report = &usage_queues[0].report;
+        len = sizeof(report_usage_t);
+        break;
+      case REPORT_ID_SYSTEM_CONTROL:
+        report = &usage_queues[1].report;
+        len = sizeof(report_usage_t);
+        break;
+      default:
+        break;
+    }
+  }
+  if (!report) return 0;
+
+  if (len > reqlen) len = reqlen;
+  memcpy(buffer, report, len);
+  return len;
+}
+
+// Invoked when sent REPORT successfully to host
+void tud_hid_report_complete_cb(uint8_t instance, uint8_t const* report, uint16_t len)
+{
+  // report is buffer of the class driver, not the queue entry sent
+  (void) report;
 
-  return 0;
+  if (instance == ITF_NUM_KEYBOARD && keyboard_inflight)
+  {
+    raw_probe_report_sent(keyboard_queue[keyboard_queue_tail].report.raw, len);
+    keyboard_inflight = false;
+    keyboard_queue_tail = (keyboard_queue_tail + 1) & (KEYBOARD_QUEUE_SIZE - 1);
+    boot_mark(BOOT_FIRST_REPORT);
+    sof_report_complete();
+  }
 }
 
 // Invoked when received SET_REPORT control request or
 // received data on OUT endpoint ( Report ID = 0, Type = 0 )
 void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t const* buffer, uint16_t bufsize)
 {
+#if RAW_ENABLE
+  // Raw HID: data on OUT endpoint, latency probe on feature report
+  if (instance == ITF_NUM_RAW)
+  {
+    (void) report_id;
+    if (report_type == HID_REPORT_TYPE_FEATURE)
+      raw_probe_set(buffer, bufsize);
+    else
+      raw_receive(buffer, bufsize);
+    return;
+  }
+#endif
   if (instance != ITF_NUM_KEYBOARD) return;
 
   if (report_type == HID_REPORT_TYPE_OUTPUT)
@@ -0,0 +1,77 @@
+#ifndef PS2_H
+#define PS2_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ps2_port.h"
+#include "profile.h"
+
+// microbenchmarks of hot paths, enabled in host build(host/Makefile)
+#ifndef MICROBENCH_ENABLE
+#define MICROBENCH_ENABLE   0
+#endif
+
+// how keyboard is quiesced while USB is suspended or unmounted
+enum {
+    QUIESCE_NONE,
+    QUIESCE_WAKE,           // scanning for remote wakeup, bytes are not decoded
+    QUIESCE_OFF,            // requested: disabled, or inhibited if not taken
+    QUIESCE_DISABLED,       // scanning disabled with F5
+    QUIESCE_INHIBITED,      // clock held low
+};
+
+typedef struct {
+    uint32_t bytes;
+    uint32_t events;
+    uint32_t errors;
+    uint32_t unknown;
+    uint32_t resets;
+    uint32_t hotplugs;      // BAT received without reset command
+} keyboard_stats_t;
+
+// PS/2 keyboard: port, decoder state and statistics
+typedef struct {
+    ps2_port_t port;
+    uint16_t id;            // 0xFFFF: not ready
+    const keyboard_profile_t *profile;
+    uint32_t detect_ms;
+    uint8_t detect_state;
+    uint16_t detect_id;     // ID bytes being read
+    uint8_t code_set;       // 2 or 3
+    uint8_t decode_state;
+    uint8_t pressed[32];    // key positions pressed on this keyboard
+    uint8_t quiesce;
+    keyboard_stats_t stats;
+} keyboard_t;
+
+// PS/2 LED bits set by host, -1: not yet
+extern volatile int8_t ps2_led;
+
+void ps2_init(void);
+void ps2_task(void);
+void ps2_set_led(int8_t led);
+void ps2_print_stats(void);
+keyboard_t *ps2_keyboard(uint8_t i);
+void ps2_redetect(keyboard_t *kbd);
+bool ps2_quiesced(void);
+bool keyboard_report_has(const uint8_t *report, uint16_t len, uint8_t usage);
+void ps2_replay(bool timed);
+#if MICROBENCH_ENABLE
+void ps2_microbench(void);
+#endif
+int8_t process_cs2(keyboard_t *kbd, uint8_t code);
+int16_t keyboard_scan_code(keyboard_t *kbd, uint8_t key);
+
+// HID report queues
+typedef struct {
+    uint32_t reports;       // queued
+    uint32_t overwrites;    // latest entry overwritten when full
+    uint8_t max_depth;
+} hid_queue_stats_t;
+
+// sink: reports are dropped one per millisecond instead of being sent
+void hid_sink(bool on);
+const hid_queue_stats_t *hid_get_queue_stats(void);
+void hid_clear_queue_stats(void);
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * PS/2 mouse on second port
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stdio.h>
+#include "pico/stdlib.h"
+
+#include "bsp/board.h"
+#include "tusb.h"
+#include "usb_descriptors.h"
+
+#include "ps2_port.h"
+#include "ps2_mouse.h"
+#include "recover.h"
+
+
+static ps2_port_t mouse_port = PS2_PORT(MOUSE_CLOCK_PIN, MOUSE_DATA_PIN);
+
+// 0xFF: not detected, 0x00: standard mouse, 0x03: IntelliMouse(wheel)
+static uint8_t mouse_id = 0xFF;
+
+// Detection steps: BAT sent by mouse at power-on is waited for first, and
+// reset command is sent only when it doesn't come by MOUSE_STARTUP_WAIT.
+// Waiting doesn't block so that startup and USB enumeration go on.
+enum {
+    MOUSE_STARTUP,  // waiting for BAT at power-on
+    MOUSE_RESET,    // reset command sent, waiting for BAT
+    MOUSE_BAT,      // BAT received, waiting for ID
+    MOUSE_NONE,     // not detected, waiting for BAT at hotplug
+    MOUSE_READY,
+};
+#define MOUSE_STARTUP_WAIT  1000    // ms
+#define MOUSE_BAT_WAIT      1000    // ms, BAT takes 500ms at most after reset
+#define MOUSE_ID_WAIT       20      // ms, ID 00 follows BAT
+static uint8_t mouse_state = MOUSE_STARTUP;
+static uint32_t mouse_detect_ms = 0;
+
+// movement packet
+static uint8_t packet[4];
+static uint8_t packet_len = 0;
+static uint8_t packet_idx = 0;
+static uint32_t packet_time = 0;
+
+// accumulated between USB polls so that no movement is lost
+static int16_t acc_x = 0;
+static int16_t acc_y = 0;
+static int16_t acc_wheel = 0;
+static uint8_t buttons = 0;
+static uint8_t buttons_sent = 0;
+
+#define MOUSE_CMD(c)    do { if (ps2_port_send(&mouse_port, (c)) != 0xFA) goto FAIL; } while (0)
+
+static void mouse_set_rate(uint8_t rate)
+{
+    ps2_port_send(&mouse_port, 0xF3);
+    ps2_port_send(&mouse_port, rate);
+}
+
+// IntelliMouse detection and setup, mouse is expected to be just after BAT
+static void mouse_setup(void)
+{
+    int16_t r;
+    recover_hold(RECOVER_SETUP_MS);
+    mouse_id = 0xFF;
+    mouse_state = MOUSE_NONE;
+    packet_idx = 0;
+
+    // IntelliMouse detection: sample rate 200, 100, 80 then read ID
+    mouse_set_rate(200);
+    mouse_set_rate(100);
+    mouse_set_rate(80);
+    MOUSE_CMD(0xF2);
+    r = ps2_port_recv_response(&mouse_port);
+    if (r == -1) goto FAIL;
+    mouse_id = (uint8_t) r;
+    packet_len = (mouse_id == 0x03) ? 4 : 3;
+
+    mouse_set_rate(MOUSE_SAMPLE_RATE);
+    MOUSE_CMD(0xF4);    // enable data reporting
+    mouse_state = MOUSE_READY;
+    printf("mouse_id:%02X\n", mouse_id);
+    return;
+FAIL:
+    mouse_id = 0xFF;
+}
+
+static void mouse_detect(int16_t c)
+{
+    uint32_t elapsed = board_millis() - mouse_detect_ms;
+    switch (mouse_state) {
+        case MOUSE_STARTUP:
+        case MOUSE_RESET:
+        case MOUSE_NONE:
+            if (c == 0xAA) {
+                mouse_detect_ms = board_millis();
+                mouse_state = MOUSE_BAT;
+            } else if (mouse_state == MOUSE_STARTUP && elapsed >= MOUSE_STARTUP_WAIT) {
+                // no BAT at power-on
+                mouse_detect_ms = board_millis();
+                mouse_state = (ps2_port_send(&mouse_port, 0xFF) == 0xFA) ? MOUSE_RESET : MOUSE_NONE;
+            } else if (mouse_state == MOUSE_RESET && elapsed >= MOUSE_BAT_WAIT) {
+                mouse_state = MOUSE_NONE;
+            }
+            break;
+        case MOUSE_BAT:
+            if (c == 0x00 || elapsed >= MOUSE_ID_WAIT) {
+                mouse_setup();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void ps2_mouse_init(void)
+{
+    ps2_port_init(&mouse_port);
+}
+
+// saturated not to reverse direction while host doesn't poll
+static int16_t acc_add(int16_t acc, int16_t v)
+{
+    int32_t sum = acc + v;
+    if (sum > INT16_MAX) sum = INT16_MAX;
+    if (sum < INT16_MIN) sum = INT16_MIN;
+    return (int16_t) sum;
+}
+
+static void mouse_packet(void)
+{
+    // sync bit, overflow
+    if (!(packet[0] & 0x08)) return;
+    if (packet[0] & 0xC0) return;
+
+    int16_t x = (int16_t) ((packet[0] & 0x10) ? packet[1] - 256 : packet[1]);
+    int16_t y = (int16_t) ((packet[0] & 0x20) ? packet[2] - 256 : packet[2]);
+    acc_x = acc_add(acc_x, x);
+    acc_y = acc_add(acc_y, (int16_t) -y);   // PS/2: up is positive, HID: down is positive
+    if (packet_len == 4) {
+        acc_wheel = acc_add(acc_wheel, (int16_t) -(int8_t) packet[3]);
+    }
+    buttons = packet[0] & 0x07;
+
+    // Remote wakeup
+    if (buttons && tud_suspended()) {
+        tud_remote_wakeup();
+    }
+}
+
+static int8_t clip(int16_t *acc)
+{
+    int16_t v = *acc;
+    if (v > 127) v = 127;
+    if (v < -127) v = -127;
+    *acc = (int16_t) (*acc - v);
+    return (int8_t) v;
+}
+
+void ps2_mouse_task(void)
+{
+    int16_t c;
+
+    while ((c = ps2_port_recv(&mouse_port)) != -1) {
+        if (mouse_state != MOUSE_READY) {
+            mouse_detect(c);
+            continue;
+        }
+
+        // resync when packet is interrupted
+        if (packet_idx && board_millis() - packet_time > 20) {
+            packet_idx = 0;
+        }
+        packet_time = board_millis();
+        if (packet_idx == 0 && !(c & 0x08)) {
+            continue;   // out of sync
+        }
+        packet[packet_idx++] = (uint8_t) c;
+        if (packet_idx == 2 && packet[0] == 0xAA && packet[1] == 0x00) {
+            // BAT after hotplug: set up without reset
+            mouse_setup();
+            continue;
+        }
+        if (packet_idx == packet_len) {
+            mouse_packet();
+            packet_idx = 0;
+        }
+    }
+
+    // timeouts of detection
+    if (mouse_state != MOUSE_READY) mouse_detect(-1);
+    if (mouse_port.error) { printf("me%02X ", mouse_port.error); mouse_port.error = 0; packet_idx = 0; }
+
+    if (!acc_x && !acc_y && !acc_wheel && buttons == buttons_sent) return;
+    if (!tud_hid_n_ready(ITF_NUM_HID)) return;
+
+    int8_t x = clip(&acc_x);
+    int8_t y = clip(&acc_y);
+    int8_t wheel = clip(&acc_wheel);
+    tud_hid_n_mouse_report(ITF_NUM_HID, REPORT_ID_MOUSE, buttons, x, y, wheel, 0);
+    buttons_sent = buttons;
+}
+
+uint8_t ps2_mouse_buttons(void)
+{
+    return buttons;
+}
@@ -0,0 +1,17 @@
+#ifndef PS2_MOUSE_H
+#define PS2_MOUSE_H
+
+#include <stdint.h>
+
+// mouse port pins: 4:clock(IRQ), 5:data
+#define MOUSE_CLOCK_PIN     4
+#define MOUSE_DATA_PIN      5
+
+// sample rate set after detection
+#define MOUSE_SAMPLE_RATE   200
+
+void ps2_mouse_init(void);
+void ps2_mouse_task(void);
+uint8_t ps2_mouse_buttons(void);
+
+#endif
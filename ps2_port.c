@@ -0,0 +1,409 @@
+/*
+ * PS/2 line driver
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+//#include "pico/critical_section.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "hardware/irq.h"
+
+#include "ps2_port.h"
+#include "capture.h"
+#include "stage.h"
+#include "masked.h"
+
+
+// port lookup from GPIO in IRQ
+static ps2_port_t *port_by_pin[NUM_BANK0_GPIOS];
+
+static void ps2_callback(uint gpio, uint32_t events);
+
+void ps2_port_init(ps2_port_t *port)
+{
+    ringbuf_init(&port->rbuf, port->buf, PS2_BUF_SIZE);
+    port->error = PS2_ERR_NONE;
+    port->response_timeout = PS2_TIMEOUT_RESPONSE;
+    port->state = 0;
+    port->data = 0;
+    port->parity = 1;
+    ps2_port_timing_reset(port);
+    port_by_pin[port->clock_pin] = port;
+
+    gpio_init(port->clock_pin);
+    gpio_init(port->data_pin);
+    gpio_set_pulls(port->clock_pin, true, false);
+    gpio_set_pulls(port->data_pin, true, false);
+    gpio_set_drive_strength(port->clock_pin, GPIO_DRIVE_STRENGTH_12MA);
+    gpio_set_drive_strength(port->data_pin, GPIO_DRIVE_STRENGTH_12MA);
+    gpio_set_dir(port->data_pin, GPIO_IN);
+    gpio_set_dir(port->clock_pin, GPIO_IN);
+    gpio_set_irq_enabled_with_callback(port->clock_pin, GPIO_IRQ_EDGE_FALL, true, &ps2_callback);
+}
+
+static void int_on(ps2_port_t *port)
+{
+    gpio_set_dir(port->clock_pin, GPIO_IN);
+    gpio_set_dir(port->data_pin, GPIO_IN);
+    gpio_set_irq_enabled(port->clock_pin, GPIO_IRQ_EDGE_FALL, true);
+}
+static void int_off(ps2_port_t *port)
+{
+    gpio_set_irq_enabled(port->clock_pin, GPIO_IRQ_EDGE_FALL, false);
+}
+
+static void clock_lo(ps2_port_t *port)
+{
+    gpio_set_dir(port->clock_pin, GPIO_OUT);
+    gpio_put(port->clock_pin, 0);
+}
+static inline void clock_hi(ps2_port_t *port)
+{
+    gpio_set_dir(port->clock_pin, GPIO_OUT);
+    gpio_put(port->clock_pin, 1);
+}
+static bool clock_in(ps2_port_t *port)
+{
+    gpio_set_dir(port->clock_pin, GPIO_IN);
+    asm("nop");
+    return gpio_get(port->clock_pin);
+}
+
+static void data_lo(ps2_port_t *port)
+{
+    gpio_set_dir(port->data_pin, GPIO_OUT);
+    gpio_put(port->data_pin, 0);
+}
+static void data_hi(ps2_port_t *port)
+{
+    gpio_set_dir(port->data_pin, GPIO_OUT);
+    gpio_put(port->data_pin, 1);
+}
+static inline bool data_in(ps2_port_t *port)
+{
+    gpio_set_dir(port->data_pin, GPIO_IN);
+    asm("nop");
+    return gpio_get(port->data_pin);
+}
+
+void ps2_port_inhibit(ps2_port_t *port)
+{
+    clock_lo(port);
+    data_hi(port);
+}
+void ps2_port_idle(ps2_port_t *port)
+{
+    clock_hi(port);
+    data_hi(port);
+}
+
+static inline uint16_t wait_clock_lo(ps2_port_t *port, uint16_t us)
+{
+    while (clock_in(port)  && us) { asm(""); wait_us(1); us--; }
+    return us;
+}
+static inline uint16_t wait_clock_hi(ps2_port_t *port, uint16_t us)
+{
+    while (!clock_in(port) && us) { asm(""); wait_us(1); us--; }
+    return us;
+}
+static inline uint16_t wait_data_lo(ps2_port_t *port, uint16_t us)
+{
+    while (data_in(port) && us)  { asm(""); wait_us(1); us--; }
+    return us;
+}
+static inline uint16_t wait_data_hi(ps2_port_t *port, uint16_t us)
+{
+    while (!data_in(port) && us)  { asm(""); wait_us(1); us--; }
+    return us;
+}
+
+void ps2_port_timing_reset(ps2_port_t *port)
+{
+    memset(&port->timing, 0, sizeof(port->timing));
+    port->timing.period_min = 0xFFFF;
+}
+
+static bool timing_learned(ps2_port_t *port)
+{
+    return port->timing.frames >= PS2_TIMING_LEARN && port->timing.commands >= PS2_TIMING_LEARN;
+}
+
+static uint16_t timeout_rts(ps2_port_t *port)
+{
+    if (!timing_learned(port)) return PS2_TIMEOUT_RTS;
+    uint32_t t = (uint32_t) port->timing.rts_max * 2 + 1000;
+    return (uint16_t) (t < PS2_TIMEOUT_RTS ? t : PS2_TIMEOUT_RTS);
+}
+
+// wait for an edge: longest clock period plus jitter, though an edge
+// normally comes within half of it
+static uint16_t timeout_bit(ps2_port_t *port)
+{
+    if (!timing_learned(port)) return PS2_TIMEOUT_BIT;
+    uint32_t t = port->timing.period_max + port->timing.jitter_max;
+    return (uint16_t) (t < PS2_TIMEOUT_BIT ? t : PS2_TIMEOUT_BIT);
+}
+
+static uint8_t timeout_response(ps2_port_t *port)
+{
+    if (!timing_learned(port)) return port->response_timeout;
+    uint32_t t = port->timing.response_max * 3 / 1000 + 3;
+    return (uint8_t) (t < port->response_timeout ? t : port->response_timeout);
+}
+
+#define WAIT(stat, us, err) do { \
+    if (!wait_##stat(port, us)) { \
+        port->error = err; \
+        goto ERROR; \
+    } \
+} while (0)
+
+int16_t ps2_port_recv(ps2_port_t *port)
+{
+    // There are alternative options for ciritcal section protection
+    //critical_section_t crit_rbuf;
+    //critical_section_init(&crit_rbuf);
+    //critical_section_enter_blocking(&crit_rbuf);      // disable IRQ and spin_lock
+    //irq_set_enabled(IO_IRQ_BANK0, false);             // disable only GPIO IRQ
+
+    uint32_t start;
+    uint32_t status = masked_disable(&start);           // disable IRQ
+    int16_t c = ringbuf_get(&port->rbuf); // critical_section
+    masked_restore(MASKED_RECV, status, start);
+
+    //irq_set_enabled(IO_IRQ_BANK0, true);
+    //critical_section_exit(&crit_rbuf);
+    return c;
+}
+
+// bytes are put only when all of them fit, so that a sequence is never cut
+bool ps2_port_inject(ps2_port_t *port, const uint8_t *data, uint8_t len)
+{
+    uint32_t start;
+    uint32_t status = masked_disable(&start);
+    bool r = ringbuf_free(&port->rbuf) >= len;
+    if (r) {
+        for (uint8_t i = 0; i < len; i++) ringbuf_put(&port->rbuf, data[i]);
+    }
+    masked_restore(MASKED_INJECT, status, start);
+    return r;
+}
+
+int16_t ps2_port_recv_response(ps2_port_t *port)
+{
+    uint8_t retry = timeout_response(port);
+    int16_t c = -1;
+    while (retry-- && (c = ps2_port_recv(port)) == -1) {
+        wait_ms(1);
+    }
+    if (c == -1) {
+        port->timing.timeouts++;
+        ps2_port_timing_reset(port);
+    }
+    if (c != -1) {
+        printf("r%02X ", c & 0xFF);
+        capture_record(port->clock_pin, CAPTURE_RESPONSE, (uint8_t) c);
+    }
+    return c;
+}
+
+int16_t ps2_port_send(ps2_port_t *port, uint8_t data)
+{
+    bool parity = true;
+    port->error = PS2_ERR_NONE;
+
+    printf("s%02X ", data);
+    capture_record(port->clock_pin, CAPTURE_SEND, data);
+
+    int_off(port);
+    uint32_t masked_start = cycles_read();
+
+    /* terminate a transmission if we have */
+    ps2_port_inhibit(port);
+    wait_us(200);
+
+    /* 'Request to Send' and Start bit */
+    data_lo(port);
+    wait_us(200);
+    clock_hi(port);
+    uint32_t t = time_us_32();
+    uint16_t bit_us = timeout_bit(port);
+    WAIT(clock_lo, timeout_rts(port), 1);
+    t = time_us_32() - t;
+    if (t > port->timing.rts_max) port->timing.rts_max = (uint16_t) t;
+
+    /* Data bit[2-9] */
+    for (uint8_t i = 0; i < 8; i++) {
+        wait_us(15);
+        if (data&(1<<i)) {
+            parity = !parity;
+            data_hi(port);
+        } else {
+            data_lo(port);
+        }
+        WAIT(clock_hi, bit_us, (int16_t) (2 + i*0x10));
+        WAIT(clock_lo, bit_us, (int16_t) (3 + i*0x10));
+    }
+
+    /* Parity bit */
+    wait_us(15);
+    if (parity) { data_hi(port); } else { data_lo(port); }
+    WAIT(clock_hi, bit_us, 4);
+    WAIT(clock_lo, bit_us, 5);
+
+    /* Stop bit */
+    wait_us(15);
+    data_hi(port);
+
+    /* Ack */
+    WAIT(data_lo, bit_us, 6);    // check Ack
+    WAIT(data_hi, bit_us, 7);
+    WAIT(clock_hi, bit_us, 8);
+
+    ringbuf_reset(&port->rbuf);   // clear buffer
+    ps2_port_idle(port);
+    t = time_us_32();
+    masked_end(MASKED_SEND, masked_start, false);
+    int_on(port);
+    int16_t c = ps2_port_recv_response(port);
+    if (c != -1) {
+        t = port->timing.rx_time - t;
+        port->timing.commands++;
+        port->timing.response_sum += t;
+        if (t > port->timing.response_max) port->timing.response_max = t;
+    }
+    return c;
+ERROR:
+    port->timing.timeouts++;
+    ps2_port_timing_reset(port);
+    printf("e%02X ", port->error);
+    capture_record(port->clock_pin, CAPTURE_ERROR, (uint8_t) port->error);
+    port->error = 0;
+    ps2_port_idle(port);
+    masked_end(MASKED_SEND, masked_start, false);
+    int_on(port);
+    return -0xf;
+}
+
+static void ps2_callback(uint gpio, uint32_t events) {
+    enum {
+        INIT,
+        START,
+        BIT0, BIT1, BIT2, BIT3, BIT4, BIT5, BIT6, BIT7,
+        PARITY,
+        STOP,
+    };
+
+    // process at falling edge of clock
+    if (events != GPIO_IRQ_EDGE_FALL) { return; }
+    ps2_port_t *port = port_by_pin[gpio];
+    if (!port) { return; }
+    masked_isr_entry(gpio_get(port->clock_pin));
+
+    uint32_t start = cycles_read();
+    uint32_t now = time_us_32();
+    uint32_t interval = now - port->edge_time;
+    port->edge_time = now;
+
+    // discard stale frame
+    if (port->state != INIT && interval > PS2_FRAME_TIMEOUT) {
+        port->error = (int16_t) (port->state + 0xE0);
+        port->state = INIT;
+        port->data = 0;
+        port->parity = 1;
+    }
+
+    port->state++;
+    if (port->state == START) {
+        port->frame_time = now;
+        port->edge_min = 0xFFFF;
+        port->edge_max = 0;
+    } else {
+        if (interval < port->edge_min) port->edge_min = (uint16_t) interval;
+        if (interval > port->edge_max) port->edge_max = (uint16_t) interval;
+    }
+
+    switch (port->state) {
+        case START:
+            // start bit is low
+            if (data_in(port))
+                goto ERROR;
+            break;
+        case BIT0:
+        case BIT1:
+        case BIT2:
+        case BIT3:
+        case BIT4:
+        case BIT5:
+        case BIT6:
+        case BIT7:
+            port->data >>= 1;
+            if (data_in(port)) {
+                port->data |= 0x80;
+                port->parity++;
+            }
+            break;
+        case PARITY:
+            if (data_in(port)) {
+                if (!(port->parity & 0x01))
+                    goto ERROR;
+            } else {
+                if (port->parity & 0x01)
+                    goto ERROR;
+            }
+            break;
+        case STOP:
+            // stop bit is high
+            if (!data_in(port))
+                goto ERROR;
+            // critical section for ringbuffer - need to do nothing here
+            // because this should be called in IRQ context.
+            // Use protection in main thread when using ringuf.
+            ringbuf_put(&port->rbuf, port->data);
+            {
+                uint16_t period = (uint16_t) ((now - port->frame_time) / (STOP - START));
+                uint16_t jitter = (uint16_t) (port->edge_max - port->edge_min);
+                port->timing.frames++;
+                port->timing.period_sum += period;
+                if (period < port->timing.period_min) port->timing.period_min = period;
+                if (period > port->timing.period_max) port->timing.period_max = period;
+                if (jitter > port->timing.jitter_max) port->timing.jitter_max = jitter;
+                port->timing.rx_time = now;
+            }
+            goto DONE;
+            break;
+        default:
+            goto ERROR;
+    }
+    goto END;
+ERROR:
+    port->error = (int16_t) (port->state + 0xF0);
+DONE:
+    port->state = INIT;
+    port->data = 0;
+    port->parity = 1;
+END:
+    stage_end(STAGE_LINE, start, (uint8_t) ((port->rbuf.head - port->rbuf.tail) & port->rbuf.size_mask));
+}
+
+void ps2_port_print_timing(ps2_port_t *port)
+{
+    printf("  frames:%lu period:%u/%lu/%uus jitter:%uus rts:%uus response:%lu/%luus timeouts:%lu\n",
+            (unsigned long) port->timing.frames,
+            port->timing.frames ? port->timing.period_min : 0,
+            (unsigned long) (port->timing.frames ? port->timing.period_sum / port->timing.frames : 0),
+            port->timing.period_max,
+            port->timing.jitter_max,
+            port->timing.rts_max,
+            (unsigned long) (port->timing.commands ? port->timing.response_sum / port->timing.commands : 0),
+            (unsigned long) port->timing.response_max,
+            (unsigned long) port->timing.timeouts);
+    printf("  timeout rts:%uus bit:%uus response:%ums\n",
+            timeout_rts(port), timeout_bit(port), timeout_response(port));
+}
@@ -0,0 +1,78 @@
+#ifndef PS2_PORT_H
+#define PS2_PORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ringbuf.h"
+
+/*
+ * PS/2 line driver: one instance per clock/data pin pair
+ *
+ * Receiving is done in GPIO IRQ at falling edge of clock and received bytes
+ * are stored in ring buffer of the port. Sending is done in main thread.
+ */
+#define PS2_ERR_NONE    0
+
+#define PS2_BUF_SIZE    16
+
+typedef struct {
+    uint8_t clock_pin;
+    uint8_t data_pin;
+
+    ringbuf_t rbuf;
+    uint8_t buf[PS2_BUF_SIZE];
+    volatile int16_t error;
+    uint8_t response_timeout;   // ms
+
+    // receiving state in IRQ
+    uint8_t state;
+    uint8_t data;
+    uint8_t parity;
+    uint32_t edge_time;     // us, last falling edge of clock
+    uint32_t frame_time;    // us, start bit
+    uint16_t edge_min;
+    uint16_t edge_max;
+
+    // line timing measured on the port, all in us
+    struct {
+        uint32_t frames;
+        uint32_t period_sum;
+        uint16_t period_min;    // clock period
+        uint16_t period_max;
+        uint16_t jitter_max;    // difference of edge intervals in a frame
+        uint32_t rx_time;       // end of last received frame
+        uint32_t commands;
+        uint32_t response_sum;
+        uint32_t response_max;  // ack of command to response byte
+        uint16_t rts_max;       // request-to-send to the first clock
+        uint32_t timeouts;
+    } timing;
+} ps2_port_t;
+
+// Timeouts adapt to measured timing after learning some frames and commands,
+// with safety margin. They fall back to the defaults on a failure so that
+// a slower keyboard plugged in later can still be detected.
+#define PS2_TIMING_LEARN        8
+#define PS2_TIMEOUT_RTS         15000   // us, 10ms [5]p.50
+#define PS2_TIMEOUT_BIT         100     // us
+#define PS2_TIMEOUT_RESPONSE    25      // ms, 25ms/20ms at most([5]p.46, [3]p.21)
+#define PS2_FRAME_TIMEOUT       2000    // us, frame should be completed within 2ms
+
+#define PS2_PORT(clock, data)   { .clock_pin = (clock), .data_pin = (data) }
+
+void ps2_port_init(ps2_port_t *port);
+int16_t ps2_port_send(ps2_port_t *port, uint8_t data);
+int16_t ps2_port_recv(ps2_port_t *port);
+bool ps2_port_inject(ps2_port_t *port, const uint8_t *data, uint8_t len);  // as if received, all or none
+int16_t ps2_port_recv_response(ps2_port_t *port);
+void ps2_port_inhibit(ps2_port_t *port);
+void ps2_port_idle(ps2_port_t *port);
+void ps2_port_timing_reset(ps2_port_t *port);
+void ps2_port_print_timing(ps2_port_t *port);
+
+#define wait_us(us)     busy_wait_us_32(us)
+#define wait_ms(ms)     busy_wait_ms(ms)
+//#define wait_us(us)     sleep_us(us)
+//#define wait_ms(ms)     sleep_ms(ms)
+
+#endif
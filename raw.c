@@ -0,0 +1,285 @@
+/*
+ * Raw HID: binary telemetry and configuration
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <string.h>
+#include "pico/stdlib.h"
+#include "tusb.h"
+#include "usb_descriptors.h"
+
+#include "raw.h"
+#include "ps2.h"
+#include "action.h"
+#include "capture.h"
+#include "sof.h"
+#include "chatter.h"
+#include "masked.h"
+
+#if RAW_ENABLE
+
+// Request is processed in main loop and response is sent when endpoint
+// is ready, one at a time. Request received while busy is dropped.
+static uint8_t request[RAW_REPORT_SIZE];
+static uint8_t response[RAW_REPORT_SIZE];
+static bool request_pending = false;
+static bool response_pending = false;
+
+static uint8_t *put16(uint8_t *p, uint16_t v)
+{
+    *p++ = (uint8_t) v;
+    *p++ = (uint8_t) (v >> 8);
+    return p;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+    p = put16(p, (uint16_t) v);
+    return put16(p, (uint16_t) (v >> 16));
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+    return (uint16_t) (p[0] | p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return get16(p) | (uint32_t) get16(p + 2) << 16;
+}
+
+static uint8_t keyboard_count(void)
+{
+    uint8_t n = 0;
+    while (ps2_keyboard(n)) n++;
+    return n;
+}
+
+// returns status, response data is written from p
+static uint8_t raw_process(const uint8_t *req, uint8_t *p)
+{
+    keyboard_t *kbd;
+    switch (req[0]) {
+        case RAW_VERSION:
+            *p++ = RAW_PROTOCOL_VERSION;
+            *p++ = keyboard_count();
+            *p++ = keymap_layers;
+            return RAW_OK;
+        case RAW_KEYBOARD_STATS:
+            if (!(kbd = ps2_keyboard(req[1]))) return RAW_ERR_ARG;
+            p = put16(p, kbd->id);
+            *p++ = kbd->code_set;
+            p = put32(p, kbd->stats.bytes);
+            p = put32(p, kbd->stats.events);
+            p = put32(p, kbd->stats.errors);
+            p = put32(p, kbd->stats.unknown);
+            p = put32(p, kbd->stats.resets);
+            p = put32(p, kbd->stats.hotplugs);
+            return RAW_OK;
+        case RAW_PORT_TIMING:
+            if (!(kbd = ps2_keyboard(req[1]))) return RAW_ERR_ARG;
+            p = put32(p, kbd->port.timing.frames);
+            p = put16(p, kbd->port.timing.period_min);
+            p = put16(p, kbd->port.timing.period_max);
+            p = put16(p, (uint16_t) (kbd->port.timing.frames ? kbd->port.timing.period_sum / kbd->port.timing.frames : 0));
+            p = put16(p, kbd->port.timing.jitter_max);
+            p = put32(p, kbd->port.timing.response_max);
+            p = put16(p, kbd->port.timing.rts_max);
+            p = put32(p, kbd->port.timing.timeouts);
+            return RAW_OK;
+        case RAW_ACTION_STATS: {
+            const action_stats_t *stats = action_get_stats();
+            p = put32(p, stats->events);
+            p = put32(p, stats->max_cycles);
+            p = put32(p, stats->events ? stats->total_cycles / stats->events : 0);
+            for (uint8_t i = 0; i < ACTION_HIST_SIZE; i++) {
+                p = put32(p, stats->hist[i]);
+            }
+            return RAW_OK;
+        }
+        case RAW_KEYMAP_GET: {
+            // fits in response: 2-byte header and 31 actions
+            uint8_t layer = req[1], key = req[2], count = req[3];
+            if (layer >= keymap_layers || count > (RAW_REPORT_SIZE - 2) / 2 || key + count > 256) return RAW_ERR_ARG;
+            for (uint8_t i = 0; i < count; i++) {
+                p = put16(p, keymaps[layer][key + i]);
+            }
+            return RAW_OK;
+        }
+        case RAW_KEYMAP_SET:
+            if (req[1] >= keymap_layers) return RAW_ERR_ARG;
+            keymaps[req[1]][req[2]] = get16(&req[3]);
+            return RAW_OK;
+        case RAW_CONFIG_GET:
+            switch (req[1]) {
+                case RAW_CONFIG_CAPTURE:
+                    put32(p, capture_enabled);
+                    return RAW_OK;
+                case RAW_CONFIG_LAYER_STATE:
+                    put32(p, layer_state);
+                    return RAW_OK;
+                case RAW_CONFIG_SOF_ALIGN:
+                    put32(p, sof_align);
+                    return RAW_OK;
+                case RAW_CONFIG_CHATTER:
+                    put32(p, chatter_window_ms);
+                    return RAW_OK;
+                default:
+                    return RAW_ERR_ARG;
+            }
+        case RAW_CONFIG_SET:
+            switch (req[1]) {
+                case RAW_CONFIG_CAPTURE:
+                    capture_enabled = get32(&req[2]) != 0;
+                    return RAW_OK;
+                case RAW_CONFIG_LAYER_STATE:
+                    // layer 0 is always active
+                    layer_state = get32(&req[2]) | 1;
+                    return RAW_OK;
+                case RAW_CONFIG_SOF_ALIGN:
+                    sof_align = get32(&req[2]) != 0;
+                    return RAW_OK;
+                case RAW_CONFIG_CHATTER:
+                    if (get32(&req[2]) > 0xFF) return RAW_ERR_ARG;
+                    chatter_window_ms = (uint8_t) get32(&req[2]);
+                    return RAW_OK;
+                default:
+                    return RAW_ERR_ARG;
+            }
+        case RAW_STATS_CLEAR:
+            for (uint8_t i = 0; (kbd = ps2_keyboard(i)); i++) {
+                memset(&kbd->stats, 0, sizeof(kbd->stats));
+                ps2_port_timing_reset(&kbd->port);
+            }
+            action_clear_stats();
+            sof_clear();
+            chatter_clear();
+            masked_clear();
+            return RAW_OK;
+        case RAW_SOF_STATS: {
+            const sof_stats_t *stats = sof_get_stats();
+            p = put32(p, stats->frames);
+            p = put32(p, stats->events);
+            p = put32(p, stats->no_sof);
+            for (uint8_t i = 0; i < SOF_HIST_SIZE; i++) {
+                p = put32(p, stats->hist[i]);
+            }
+            p = put16(p, stats->in_offset);
+            p = put32(p, stats->late);
+            return RAW_OK;
+        }
+        case RAW_CHATTER_STATS: {
+            const chatter_stats_t *stats = chatter_get_stats();
+            uint8_t key = req[1], count = req[2];
+            if (count > RAW_REPORT_SIZE - 2 - 4 || key + count > 256) return RAW_ERR_ARG;
+            p = put32(p, stats->suppressed);
+            memcpy(p, &stats->count[key], count);
+            return RAW_OK;
+        }
+        default:
+            return RAW_ERR_CMD;
+    }
+}
+
+static uint32_t probe_time;
+static uint32_t probe_latency = 0xFFFFFFFF;
+static bool probe_pending = false;
+static bool probe_make;
+static uint8_t probe_usage;
+
+void raw_probe_set(uint8_t const *buf, uint16_t len)
+{
+    probe_pending = false;
+    probe_time = time_us_32();
+    probe_latency = RAW_PROBE_REJECTED;
+
+    keyboard_t *kbd = ps2_keyboard(0);
+    if (len < 2 || !kbd || kbd->id == 0xFFFF) return;
+
+    // translated into Code Set 3 when keyboard is in it
+    int16_t code = keyboard_scan_code(kbd, buf[0]);
+    if (code == -1) return;
+
+    // break code is injected with F0 at once, or not at all
+    uint8_t seq[2] = { 0xF0, (uint8_t) code };
+    if (!ps2_port_inject(&kbd->port, buf[1] ? &seq[1] : seq, buf[1] ? 1 : 2)) return;
+    probe_latency = 0xFFFFFFFF;
+    probe_pending = true;
+    probe_make = buf[1];
+    probe_usage = len > 2 ? buf[2] : 0;
+}
+
+uint16_t raw_probe_get(uint8_t *buf, uint16_t reqlen)
+{
+    uint8_t result[RAW_PROBE_SIZE] = { 0 };
+    uint8_t *p = put32(result, probe_time);
+    put32(p, probe_latency);
+    uint16_t len = reqlen < sizeof(result) ? reqlen : sizeof(result);
+    memcpy(buf, result, len);
+    return len;
+}
+
+// keyboard report completed: reports of other keys are skipped
+void raw_probe_report_sent(uint8_t const *report, uint16_t len)
+{
+    if (!probe_pending) return;
+    if (probe_usage && keyboard_report_has(report, len, probe_usage) != probe_make) return;
+    probe_latency = time_us_32() - probe_time;
+    probe_pending = false;
+}
+
+void raw_receive(uint8_t const *buf, uint16_t len)
+{
+    if (request_pending || response_pending) return;
+    memset(request, 0, sizeof(request));
+    memcpy(request, buf, len < sizeof(request) ? len : sizeof(request));
+    request_pending = true;
+}
+
+void raw_task(void)
+{
+    if (request_pending) {
+        memset(response, 0, sizeof(response));
+        response[0] = request[0];
+        response[1] = raw_process(request, &response[2]);
+        request_pending = false;
+        response_pending = true;
+    }
+    if (response_pending && tud_hid_n_ready(ITF_NUM_RAW)) {
+        tud_hid_n_report(ITF_NUM_RAW, 0, response, sizeof(response));
+        response_pending = false;
+    }
+}
+
+#else
+
+void raw_receive(uint8_t const *buf, uint16_t len)
+{
+    (void) buf;
+    (void) len;
+}
+
+void raw_task(void) {}
+
+void raw_probe_set(uint8_t const *buf, uint16_t len)
+{
+    (void) buf;
+    (void) len;
+}
+
+uint16_t raw_probe_get(uint8_t *buf, uint16_t reqlen)
+{
+    (void) buf;
+    (void) reqlen;
+    return 0;
+}
+
+void raw_probe_report_sent(uint8_t const *report, uint16_t len)
+{
+    (void) report;
+    (void) len;
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef RAW_H
+#define RAW_H
+
+#include <stdint.h>
+
+/*
+ * Raw HID: binary telemetry and configuration on vendor-defined interface
+ *
+ * Host writes 64-byte request and reads 64-byte response. Multi-byte values
+ * are little endian. tools/rawhid.py is the host side.
+ *
+ *   request:   cmd, arg...
+ *   response:  cmd, status, data...
+ */
+#define RAW_PROTOCOL_VERSION    1
+
+enum {
+    RAW_VERSION = 0x01,     // -> version, keyboards, layers
+    RAW_KEYBOARD_STATS,     // kbd -> id:16, code_set, bytes, events, errors, unknown, resets, hotplugs:32
+    RAW_PORT_TIMING,        // kbd -> frames:32, period min/max/avg:16, jitter:16, response max:32, rts max:16, timeouts:32
+    RAW_ACTION_STATS,       // -> events, max cycles, avg cycles, hist[ACTION_HIST_SIZE]:32
+    RAW_KEYMAP_GET,         // layer, key, count -> action:16 * count
+    RAW_KEYMAP_SET,         // layer, key, action:16
+    RAW_CONFIG_GET,         // item -> value:32
+    RAW_CONFIG_SET,         // item, value:32
+    RAW_STATS_CLEAR,
+    RAW_SOF_STATS,          // -> frames, events, no_sof, hist[SOF_HIST_SIZE]:32, in_offset:16, late:32
+    RAW_CHATTER_STATS,      // key, count -> suppressed:32, per key count * count
+};
+
+enum {
+    RAW_OK,
+    RAW_ERR_CMD,
+    RAW_ERR_ARG,
+};
+
+enum {
+    RAW_CONFIG_CAPTURE,     // capture of PS/2 traffic on/off
+    RAW_CONFIG_LAYER_STATE, // active layers
+    RAW_CONFIG_SOF_ALIGN,   // reports held until the end of frame on/off
+    RAW_CONFIG_CHATTER,     // chatter filter window in ms, 0: off
+};
+
+// from tud_hid_set_report_cb
+void raw_receive(uint8_t const *buf, uint16_t len);
+void raw_task(void);
+
+/*
+ * Latency probe: feature report on control pipe so that it is not delayed
+ * by polling interval of OUT endpoint
+ *
+ *   set:   code, make, usage   Code Set 2 code(not E0-prefixed) injected to
+ *                              receive buffer of the first keyboard, in Code
+ *                              Set 3 when the keyboard is in it, and HID
+ *                              usage it is mapped to(0: any)
+ *   get:   time:32, latency:32 injection time of the last probe and from it
+ *                              to completion of the first keyboard report
+ *                              with the usage pressed or released, us
+ *                              0xFFFFFFFF while not completed
+ *                              RAW_PROBE_REJECTED when not injected: keyboard
+ *                              not ready, no room in buffer or no such key in
+ *                              Code Set 3
+ */
+#define RAW_PROBE_REJECTED  0xFFFFFFFE
+void raw_probe_set(uint8_t const *buf, uint16_t len);
+uint16_t raw_probe_get(uint8_t *buf, uint16_t reqlen);
+void raw_probe_report_sent(uint8_t const *report, uint16_t len);
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * Hang recovery with hardware watchdog
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/watchdog.h"
+#include "bsp/board.h"
+
+#include "recover.h"
+#include "ps2.h"
+#include "action.h"
+
+
+#define RECOVER_MAGIC   0x52325350  // "PS2R"
+
+static recover_state_t __uninitialized_ram(saved);
+static bool recovered = false;
+static bool held = false;
+static uint32_t save_ms;
+static uint32_t feed_us;
+static uint32_t feed_max_us;    // longest interval between feeds without hold
+
+// FNV-1a of the state up to checksum
+static uint32_t checksum(const recover_state_t *state)
+{
+    const uint8_t *p = (const uint8_t *) state;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < offsetof(recover_state_t, checksum); i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void recover_init(void)
+{
+    // RAM holds garbage after power-on and other resets
+    if (watchdog_enable_caused_reboot() &&
+            saved.magic == RECOVER_MAGIC && saved.checksum == checksum(&saved)) {
+        recovered = true;
+        saved.reboots++;
+        layer_state = saved.layer_state;
+        ps2_led = saved.led;
+    } else {
+        memset(&saved, 0, sizeof(saved));
+    }
+
+#if RECOVER_WATCHDOG_MS
+    watchdog_enable(RECOVER_WATCHDOG_MS, true);
+#endif
+    feed_us = time_us_32();
+}
+
+static void recover_save(void)
+{
+    saved.magic = RECOVER_MAGIC;
+    // release of keys held now is lost by reboot: their layers would stick
+    saved.layer_state = layer_state & ~layer_held();
+    saved.led = ps2_led;
+    for (uint8_t i = 0; i < RECOVER_KEYBOARDS; i++) {
+        recover_keyboard_t *k = &saved.keyboards[i];
+        keyboard_t *kbd = ps2_keyboard(i);
+        if (!kbd) {
+            k->id = 0xFFFF;
+            continue;
+        }
+        k->id = kbd->id;
+        k->code_set = kbd->code_set;
+        k->quiesce = kbd->quiesce;
+        k->stats = kbd->stats;
+    }
+    saved.checksum = checksum(&saved);
+}
+
+// main loop path blocking near watchdog period is missing recover_hold()
+static void recover_check(uint32_t interval)
+{
+    if (interval <= feed_max_us) return;
+    feed_max_us = interval;
+    if (RECOVER_WATCHDOG_MS && interval > RECOVER_WATCHDOG_MS * 1000 / 2) {
+        printf("recover: main loop blocked %lums\n", (unsigned long) (interval / 1000));
+    }
+}
+
+void recover_task(void)
+{
+    uint32_t now = time_us_32();
+    if (held) {
+        held = false;
+#if RECOVER_WATCHDOG_MS
+        watchdog_enable(RECOVER_WATCHDOG_MS, true);
+#endif
+    } else {
+        recover_check(now - feed_us);
+#if RECOVER_WATCHDOG_MS
+        watchdog_update();
+#endif
+    }
+    feed_us = now;
+
+    if (board_millis() - save_ms < RECOVER_SAVE_MS) return;
+    save_ms = board_millis();
+    recover_save();
+}
+
+void recover_hold(uint32_t ms)
+{
+#if RECOVER_WATCHDOG_MS
+    watchdog_enable(ms, true);
+#else
+    (void) ms;
+#endif
+    held = true;
+}
+
+const recover_state_t *recover_state(void)
+{
+    return recovered ? &saved : NULL;
+}
+
+void recover_print(void)
+{
+    printf("watchdog:%ums reboots:%lu recovered:%u loop_max:%luus\n",
+            RECOVER_WATCHDOG_MS, (unsigned long) saved.reboots, recovered,
+            (unsigned long) feed_max_us);
+}
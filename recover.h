@@ -0,0 +1,56 @@
+#ifndef RECOVER_H
+#define RECOVER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ps2.h"
+
+/*
+ * Hang recovery with hardware watchdog
+ *
+ * Watchdog is fed from main loop and reboots the converter when the loop
+ * is stuck for RECOVER_WATCHDOG_MS. Paths which may block longer, PS/2
+ * command sequences with response timeouts and dumps on CDC, hold it with
+ * recover_hold() first. The longest interval between feeds without hold is
+ * measured and a warning is printed when it exceeds half of the period.
+ *
+ * State is saved periodically in RAM which is not initialized at startup,
+ * with checksum, and is restored after watchdog reboot: keyboards stay
+ * powered and keep their code set and settings, so they are ready without
+ * detection. Toggled layers, LED state and error counters are carried over;
+ * layers of keys held at reboot are not, as their release is lost with the
+ * key state. USB is enumerated again.
+ */
+#ifndef RECOVER_WATCHDOG_MS
+#define RECOVER_WATCHDOG_MS 500     // 0: disabled
+#endif
+#define RECOVER_COMMAND_MS  8000    // console command may block on CDC
+#define RECOVER_SETUP_MS    2000    // PS/2 command sequence: ~40ms per command at worst
+#define RECOVER_SAVE_MS     10
+#define RECOVER_KEYBOARDS   4
+
+typedef struct {
+    uint16_t id;            // 0xFFFF: not ready
+    uint8_t code_set;
+    uint8_t quiesce;
+    keyboard_stats_t stats;
+} recover_keyboard_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t reboots;       // by watchdog
+    uint32_t layer_state;
+    int8_t led;
+    recover_keyboard_t keyboards[RECOVER_KEYBOARDS];
+    uint32_t checksum;
+} recover_state_t;
+
+void recover_init(void);
+void recover_task(void);
+// longer timeout until next recover_task()
+void recover_hold(uint32_t ms);
+// saved state when restarted by watchdog, NULL otherwise
+const recover_state_t *recover_state(void);
+void recover_print(void);
+
+#endif
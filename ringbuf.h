@@ -18,6 +18,7 @@ static inline bool ringbuf_put(ringbuf_t *buf, uint8_t data);
 static inline void ringbuf_write(ringbuf_t *buf, uint8_t data);
 static inline bool ringbuf_is_empty(ringbuf_t *buf);
 static inline bool ringbuf_is_full(ringbuf_t *buf);
+static inline uint8_t ringbuf_free(ringbuf_t *buf);
 static inline void ringbuf_reset(ringbuf_t *buf);
 static inline void ringbuf_push(ringbuf_t *buf, uint8_t data);
 
@@ -66,6 +67,11 @@ static inline bool ringbuf_is_full(ringbuf_t *buf)
 {
     return (((buf->head + 1) & buf->size_mask) == buf->tail);
 }
+// number of bytes that can be put
+static inline uint8_t ringbuf_free(ringbuf_t *buf)
+{
+    return (uint8_t) ((buf->tail - buf->head - 1) & buf->size_mask);
+}
 static inline void ringbuf_reset(ringbuf_t *buf)
 {
     buf->head = 0;
@@ -0,0 +1,136 @@
+/*
+ * USB frame timing from SOF
+ *
+ * License: MIT
+ * Copyright 2022 Jun WAKO <wakojun@gmail.com>
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "tusb.h"
+
+#include "sof.h"
+
+
+bool sof_align = false;
+
+static volatile uint32_t sof_time;     // us, 0: no SOF yet
+static sof_stats_t sof_stats = { .in_offset = SOF_PERIOD_US };
+
+// earliest transfer completion in frame of the current samples
+static uint16_t in_min = SOF_PERIOD_US;
+static uint8_t in_samples = 0;
+
+// us, when reports started to be held, 0: not held
+static uint32_t hold_time = 0;
+
+void sof_init(void)
+{
+    tud_sof_cb_enable(true);
+}
+
+// Invoked on SOF every frame
+void tud_sof_cb(uint32_t frame_count)
+{
+    (void) frame_count;
+    sof_time = time_us_32();
+    if (!sof_time) sof_time = 1;
+    sof_stats.frames++;
+}
+
+// time since the latest SOF, SOF_STALE_US when there is no recent one
+static uint32_t sof_elapsed(void)
+{
+    if (!sof_time) return SOF_STALE_US;
+    uint32_t elapsed = time_us_32() - sof_time;
+    return elapsed < SOF_STALE_US ? elapsed : SOF_STALE_US;
+}
+
+void sof_event(void)
+{
+    uint32_t elapsed = sof_elapsed();
+    sof_stats.events++;
+    if (elapsed >= SOF_STALE_US) {
+        sof_stats.no_sof++;
+        return;
+    }
+    uint32_t to_next = SOF_PERIOD_US - elapsed % SOF_PERIOD_US;
+    uint8_t n = (uint8_t) ((to_next - 1) * SOF_HIST_SIZE / SOF_PERIOD_US);
+    sof_stats.hist[n]++;
+}
+
+// Invoked on completion of keyboard report transfer: IN token was just before
+void sof_report_complete(void)
+{
+    uint32_t elapsed = sof_elapsed();
+    if (elapsed >= SOF_STALE_US) return;
+    uint16_t phase = (uint16_t) (elapsed % SOF_PERIOD_US);
+    if (phase < in_min) in_min = phase;
+    if (++in_samples < SOF_IN_SAMPLES) return;
+    sof_stats.in_offset = in_min;
+    in_min = SOF_PERIOD_US;
+    in_samples = 0;
+}
+
+// just before IN token, or frame timing is unknown and reports are not held
+static bool in_window(void)
+{
+    uint32_t elapsed = sof_elapsed();
+    if (elapsed >= SOF_PERIOD_US) return true;  // SOF is late or missing
+    if (sof_stats.in_offset >= SOF_PERIOD_US) return elapsed >= SOF_COMMIT_US;
+
+    uint32_t start = ((uint32_t) sof_stats.in_offset + SOF_PERIOD_US - SOF_GUARD_US) % SOF_PERIOD_US;
+    return (elapsed + SOF_PERIOD_US - start) % SOF_PERIOD_US < SOF_GUARD_US;
+}
+
+// in window, or held for a whole frame as the window was missed
+bool sof_commit_window(void)
+{
+    uint32_t now = time_us_32();
+    if (in_window()) {
+        hold_time = 0;
+        return true;
+    }
+    if (!hold_time) {
+        hold_time = now ? now : 1;
+        return false;
+    }
+    if (now - hold_time < SOF_PERIOD_US) return false;
+    hold_time = 0;
+    sof_stats.late++;
+    return true;
+}
+
+const sof_stats_t *sof_get_stats(void)
+{
+    return &sof_stats;
+}
+
+void sof_print(void)
+{
+    printf("sof align:%s frames:%lu events:%lu no_sof:%lu late:%lu in_offset:",
+            sof_align ? "on" : "off",
+            (unsigned long) sof_stats.frames,
+            (unsigned long) sof_stats.events,
+            (unsigned long) sof_stats.no_sof,
+            (unsigned long) sof_stats.late);
+    if (sof_stats.in_offset < SOF_PERIOD_US) {
+        printf("%uus\n", sof_stats.in_offset);
+    } else {
+        printf("unknown\n");
+    }
+    printf("to next SOF(us):");
+    for (uint8_t i = 0; i < SOF_HIST_SIZE; i++) {
+        printf(" <%u:%lu", (i + 1) * SOF_PERIOD_US / SOF_HIST_SIZE, (unsigned long) sof_stats.hist[i]);
+    }
+    printf("\n");
+}
+
+// IN token offset is kept, it is used for alignment
+void sof_clear(void)
+{
+    uint16_t in_offset = sof_stats.in_offset;
+    memset(&sof_stats, 0, sizeof(sof_stats));
+    sof_stats.in_offset = in_offset;
+}
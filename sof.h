@@ -0,0 +1,52 @@
+#ifndef SOF_H
+#define SOF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * USB frame timing from SOF
+ *
+ * Phase of each key event to the next SOF is recorded in a histogram. With
+ * alignment on, reports are held so that changes within a frame are
+ * committed together shortly before the IN token of the next one.
+ *
+ * Offset of the IN token in frame is not known to device. It is estimated
+ * from the earliest completion of keyboard report transfers relative to SOF
+ * over SOF_IN_SAMPLES transfers, and reports are committed from SOF_GUARD_US
+ * before it; after SOF_COMMIT_US in frame until it is estimated.
+ *
+ * SOF and completion times are taken in callbacks which TinyUSB calls from
+ * tud_task(), so both lag by main loop latency and the estimate is only as
+ * good as the loop is fast. When the loop misses the window, held reports
+ * are committed anyway once they have waited a whole frame(late), so that
+ * a slow loop delays them by one frame at most instead of holding them.
+ */
+#define SOF_PERIOD_US   1000    // full speed frame
+#define SOF_COMMIT_US   850     // reports are submitted after this in frame, IN token offset unknown
+#define SOF_GUARD_US    150     // reports are submitted this long before IN token
+#define SOF_IN_SAMPLES  64      // transfer completions to take IN token offset from
+#define SOF_STALE_US    3000    // no SOF: suspended, not mounted
+#define SOF_HIST_SIZE   10      // 100us buckets of time to next SOF
+
+typedef struct {
+    uint32_t frames;
+    uint32_t events;
+    uint32_t no_sof;    // events without recent SOF
+    uint32_t hist[SOF_HIST_SIZE];
+    uint16_t in_offset; // us, IN token offset in frame, SOF_PERIOD_US: unknown
+    uint32_t late;      // commits after window was missed for a frame
+} sof_stats_t;
+
+extern bool sof_align;
+
+void sof_init(void);
+void sof_event(void);
+void sof_report_complete(void);
+// called only while reports are held
+bool sof_commit_window(void);
+const sof_stats_t *sof_get_stats(void);
+void sof_print(void);
+void sof_clear(void);
+
+#endif
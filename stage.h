@@ -0,0 +1,52 @@
+#ifndef STAGE_H
+#define STAGE_H
+
+#include <stdint.h>
+#include "cycles.h"
+
+/*
+ * Event pipeline stages and their statistics
+ *
+ *   line(IRQ) -> rbuf -> scan -> key events -> map -> usage events -> report -> report queue -> usb
+ *
+ *   line:      PS/2 frame in GPIO IRQ, per clock edge
+ *   scan:      scan code decoder to key position events
+ *   map:       keymap and actions to usage events
+ *   report:    usage events to HID reports
+ *   usb:       report submission to TinyUSB
+ *
+ * Stages are connected with small fixed-size queues. Depth is the number of
+ * events waiting in the input queue of the stage when it runs.
+ */
+enum {
+    STAGE_LINE,
+    STAGE_SCAN,
+    STAGE_MAP,
+    STAGE_REPORT,
+    STAGE_USB,
+    STAGE_COUNT
+};
+
+typedef struct {
+    uint32_t count;
+    uint32_t cycles_total;
+    uint32_t cycles_max;
+    uint8_t depth_max;
+} stage_t;
+
+// ps2.c
+extern stage_t stages[STAGE_COUNT];
+void stage_print(void);
+void stage_clear(void);
+
+static inline void stage_end(uint8_t stage, uint32_t start, uint8_t depth)
+{
+    stage_t *s = &stages[stage];
+    uint32_t cycles = cycles_since(start);
+    s->count++;
+    s->cycles_total += cycles;
+    if (cycles > s->cycles_max) s->cycles_max = cycles;
+    if (depth > s->depth_max) s->depth_max = depth;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+#
+# Convert logic analyzer dump on CDC to VCD
+#
+#   la2vcd.py capture.txt > capture.vcd
+#
+# Input is the text between 'la:' line and 'end' line printed by 'l' command.
+#
+import sys
+
+
+def main():
+    src = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+    rate = 1000000
+    runs = []
+    started = False
+    for line in src:
+        line = line.strip()
+        if line.startswith('la: rate='):
+            for kv in line[4:].split():
+                k, v = kv.split('=')
+                if k == 'rate':
+                    rate = int(v)
+            started = True
+            runs = []
+            continue
+        if not started:
+            continue
+        if line == 'end':
+            break
+        for tok in line.split():
+            state, length = tok.split(':')
+            runs.append((int(state), int(length)))
+
+    out = sys.stdout
+    out.write('$timescale %dns $end\n' % (1000000000 // rate))
+    out.write('$scope module ps2 $end\n')
+    out.write('$var wire 1 c clock $end\n')
+    out.write('$var wire 1 d data $end\n')
+    out.write('$upscope $end\n$enddefinitions $end\n')
+
+    t = 0
+    prev = None
+    for state, length in runs:
+        out.write('#%d\n' % t)
+        if prev is None or (state ^ prev) & 1:
+            out.write('%dc\n' % (state & 1))
+        if prev is None or (state ^ prev) & 2:
+            out.write('%dd\n' % ((state >> 1) & 1))
+        prev = state
+        t += length
+    out.write('#%d\n' % t)
+
+
+if __name__ == '__main__':
+    main()
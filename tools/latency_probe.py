@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+#
+# End-to-end latency with probe feature report of raw HID(raw.h)
+#
+#   latency_probe.py [-n count] [-c code]
+#
+# Code Set 2 make/break of the probe key(F24 by default) is injected into
+# the first keyboard with SET_REPORT(Feature) and time to the matching input
+# report on keyboard interface is measured on host. Device side time from
+# injection to completion of the report is read back with GET_REPORT(Feature).
+#
+# Keyboard interface must be readable with hidapi: hidraw on Linux.
+# Requires hidapi: pip install hidapi
+#
+import argparse
+import struct
+import sys
+import time
+
+import hid
+
+from rawhid import VID, open_device
+
+KEYBOARD_ITF = 0
+PROBE_SIZE = 8
+TIMEOUT = 1000      # ms
+CS2_F24 = 0x5F
+USAGE_F24 = 0x73
+PROBE_REJECTED = 0xFFFFFFFE
+
+
+def open_keyboard():
+    for d in hid.enumerate(VID):
+        if (d.get('usage_page') == 0x01 and d.get('usage') == 0x06) or d.get('interface_number') == KEYBOARD_ITF:
+            dev = hid.device()
+            dev.open_path(d['path'])
+            return dev
+    sys.exit('keyboard interface not found')
+
+
+def pressed(report, usage):
+    # NKRO: modifiers then bitmap of usages, boot: modifiers, reserved and 6 keys
+    if len(report) > 8:
+        i = 1 + usage // 8
+        return i < len(report) and report[i] & (1 << (usage % 8)) != 0
+    return usage in report[2:8]
+
+
+def device_latency(raw):
+    res = bytes(raw.get_feature_report(0, PROBE_SIZE + 1))
+    _, latency = struct.unpack_from('<II', res, len(res) - PROBE_SIZE)
+    return latency
+
+
+def probe(raw, kbd, code, usage, make):
+    t = time.perf_counter()
+    raw.send_feature_report(bytes([0, code, make, usage]) + bytes(PROBE_SIZE - 3))
+    while True:
+        report = kbd.read(64, TIMEOUT)
+        if not report:
+            if device_latency(raw) == PROBE_REJECTED:
+                sys.exit('probe rejected: no room or key not in code set of keyboard')
+            sys.exit('no report for probe')
+        if pressed(report, usage) == bool(make):
+            break
+    host = time.perf_counter() - t
+    return host * 1000000, device_latency(raw)
+
+
+def stats(name, samples):
+    s = sorted(samples)
+    pct = lambda p: s[min(len(s) - 1, len(s) * p // 100)]
+    print('%-7s n:%d min:%.0f avg:%.0f p50:%.0f p99:%.0f max:%.0f us' % (
+        name, len(s), s[0], sum(s) / len(s), pct(50), pct(99), s[-1]))
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('-n', type=int, default=1000, help='number of probes')
+    ap.add_argument('-c', type=lambda x: int(x, 0), default=CS2_F24, help='Code Set 2 code of probe key')
+    ap.add_argument('-u', type=lambda x: int(x, 0), default=USAGE_F24, help='HID usage of probe key')
+    ap.add_argument('-i', type=float, default=0.01, help='interval in seconds')
+    args = ap.parse_args()
+
+    raw = open_device()
+    kbd = open_keyboard()
+    host, device = [], []
+    for _ in range(args.n):
+        for make in (1, 0):
+            h, d = probe(raw, kbd, args.c, args.u, make)
+            host.append(h)
+            if d != 0xFFFFFFFF:
+                device.append(d)
+            time.sleep(args.i)
+    stats('host', host)
+    if device:
+        stats('device', device)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+#
+# Compare microbenchmark output of host build('ps2host -b') with baseline
+#
+#   mbcmp.py log.txt                    compare, exit 1 on regression
+#   mbcmp.py --threshold 5 log.txt      regression threshold in percent(default 10)
+#   mbcmp.py --update log.txt           write results to baseline
+#
+# Input contains 'mb:' lines. When a benchmark appears more than once, from
+# repeated runs, the best result is taken to reduce noise of the host.
+#
+import argparse
+import os
+import sys
+
+BASELINE = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'microbench_baseline.txt')
+
+
+def parse_log(f):
+    results = {}
+    for line in f:
+        line = line.strip()
+        if not line.startswith('mb: '):
+            continue
+        fields = line[4:].split()
+        kv = dict(x.split('=') for x in fields[1:])
+        ns = float(kv['ns/op'])
+        results[fields[0]] = min(ns, results.get(fields[0], ns))
+    return results
+
+
+def read_baseline(path):
+    base = {}
+    if not os.path.exists(path):
+        return base
+    for line in open(path):
+        line = line.split('#')[0].strip()
+        if line:
+            name, ns = line.split()
+            base[name] = float(ns)
+    return base
+
+
+def write_baseline(path, results):
+    with open(path, 'w') as f:
+        f.write('# Microbenchmark baseline: <name> <ns/op>\n')
+        f.write('# Generated with: tools/mbcmp.py --update <log of ps2host -b>\n')
+        f.write('# Numbers depend on host machine, update before comparing on other one.\n')
+        for name, ns in results.items():
+            f.write('%s %.1f\n' % (name, ns))
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('log', nargs='?')
+    ap.add_argument('--baseline', default=BASELINE)
+    ap.add_argument('--threshold', type=float, default=10.0)
+    ap.add_argument('--update', action='store_true')
+    args = ap.parse_args()
+
+    results = parse_log(open(args.log) if args.log else sys.stdin)
+    if not results:
+        sys.exit('no mb: lines in input')
+    if args.update:
+        write_baseline(args.baseline, results)
+        return
+
+    base = read_baseline(args.baseline)
+    regressions = 0
+    for name, ns in results.items():
+        if name not in base:
+            print('%-20s %8.1f ns/op   (no baseline)' % (name, ns))
+            continue
+        diff = (ns - base[name]) * 100 / base[name]
+        flag = ''
+        if diff > args.threshold:
+            flag = '  REGRESSION'
+            regressions += 1
+        print('%-20s %8.1f ns/op %+6.1f%%%s' % (name, ns, diff, flag))
+    sys.exit(1 if regressions else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+#
+# Host side of raw HID telemetry and configuration(raw.h)
+#
+#   rawhid.py version
+#   rawhid.py stats [kbd]
+#   rawhid.py timing [kbd]
+#   rawhid.py action
+#   rawhid.py keymap <layer> [key [count]]
+#   rawhid.py setkey <layer> <key> <action>
+#   rawhid.py config <capture|layer|sof|chatter>
+#   rawhid.py set <capture|layer|sof|chatter> <value>
+#   rawhid.py clear
+#   rawhid.py sof
+#   rawhid.py chatter
+#
+# Numbers can be given in hex with 0x. Requires hidapi: pip install hidapi
+#
+import struct
+import sys
+
+import hid
+
+VID = 0x7E57
+USAGE_PAGE = 0xFF00
+RAW_ITF = 2
+REPORT_SIZE = 64
+
+VERSION, KEYBOARD_STATS, PORT_TIMING, ACTION_STATS, KEYMAP_GET, KEYMAP_SET, \
+    CONFIG_GET, CONFIG_SET, STATS_CLEAR, SOF_STATS, CHATTER_STATS = range(1, 12)
+CONFIG = {'capture': 0, 'layer': 1, 'sof': 2, 'chatter': 3}
+STATUS = {0: 'ok', 1: 'unknown command', 2: 'bad argument'}
+ACTION_HIST_SIZE = 12
+SOF_HIST_SIZE = 10
+
+
+def open_device():
+    for d in hid.enumerate(VID):
+        # usage page is not available on some platforms, interface number is used instead
+        if d.get('usage_page') == USAGE_PAGE or d.get('interface_number') == RAW_ITF:
+            dev = hid.device()
+            dev.open_path(d['path'])
+            return dev
+    sys.exit('device not found')
+
+
+def request(dev, cmd, args=b''):
+    req = bytes([cmd]) + args
+    # first byte is report ID(none)
+    dev.write(b'\x00' + req + bytes(REPORT_SIZE - len(req)))
+    res = bytes(dev.read(REPORT_SIZE, 1000))
+    if len(res) < 2 or res[0] != cmd:
+        sys.exit('no response')
+    if res[1] != 0:
+        sys.exit('error: %s' % STATUS.get(res[1], res[1]))
+    return res[2:]
+
+
+def num(s):
+    return int(s, 0)
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit('usage: rawhid.py version|stats|timing|action|keymap|setkey|config|set|clear|sof|chatter [args]')
+    cmd, args = sys.argv[1], [num(a) if a not in CONFIG else a for a in sys.argv[2:]]
+    dev = open_device()
+
+    if cmd == 'version':
+        ver, kbds, layers = request(dev, VERSION)[:3]
+        print('protocol:%d keyboards:%d layers:%d' % (ver, kbds, layers))
+    elif cmd == 'stats':
+        kbd = args[0] if args else 0
+        v = struct.unpack_from('<HB6I', request(dev, KEYBOARD_STATS, bytes([kbd])))
+        print('kbd[%d] id:%04X set:%d bytes:%d events:%d errors:%d unknown:%d resets:%d hotplugs:%d' % ((kbd,) + v))
+    elif cmd == 'timing':
+        kbd = args[0] if args else 0
+        v = struct.unpack_from('<I4HIHI', request(dev, PORT_TIMING, bytes([kbd])))
+        print('kbd[%d] frames:%d period:%d-%d(avg %d)us jitter:%dus response:%dus rts:%dus timeouts:%d' % ((kbd,) + v))
+    elif cmd == 'action':
+        v = struct.unpack_from('<3I%dI' % ACTION_HIST_SIZE, request(dev, ACTION_STATS))
+        print('events:%d max:%dcyc avg:%dcyc' % v[:3])
+        for i, n in enumerate(v[3:]):
+            upper = '<%d' % (64 << i) if i < ACTION_HIST_SIZE - 1 else '>=%d' % (32 << i)
+            print('  %8s: %d' % (upper, n))
+    elif cmd == 'keymap':
+        layer = args[0]
+        key = args[1] if len(args) > 1 else 0
+        count = args[2] if len(args) > 2 else 256 - key
+        while count > 0:
+            n = min(count, (REPORT_SIZE - 2) // 2)
+            res = request(dev, KEYMAP_GET, bytes([layer, key, n]))
+            for i, a in enumerate(struct.unpack_from('<%dH' % n, res)):
+                print('%02X: %04X' % (key + i, a))
+            key += n
+            count -= n
+    elif cmd == 'setkey':
+        request(dev, KEYMAP_SET, struct.pack('<BBH', args[0], args[1], args[2]))
+    elif cmd == 'config':
+        v, = struct.unpack_from('<I', request(dev, CONFIG_GET, bytes([CONFIG[args[0]]])))
+        print('%s: %08X' % (args[0], v))
+    elif cmd == 'set':
+        request(dev, CONFIG_SET, struct.pack('<BI', CONFIG[args[0]], args[1]))
+    elif cmd == 'clear':
+        request(dev, STATS_CLEAR)
+    elif cmd == 'sof':
+        v = struct.unpack_from('<3I%dIHI' % SOF_HIST_SIZE, request(dev, SOF_STATS))
+        print('frames:%d events:%d no_sof:%d late:%d in_offset:%s' %
+              (v[0], v[1], v[2], v[-1], '%dus' % v[-2] if v[-2] < 1000 else 'unknown'))
+        for i, n in enumerate(v[3:-2]):
+            print('  <%4dus: %d' % ((i + 1) * 1000 // SOF_HIST_SIZE, n))
+    elif cmd == 'chatter':
+        key = 0
+        while key < 256:
+            n = min(256 - key, REPORT_SIZE - 6)
+            res = request(dev, CHATTER_STATS, bytes([key, n]))
+            if key == 0:
+                print('suppressed:%d' % struct.unpack_from('<I', res)[0])
+            for i, c in enumerate(res[4:4 + n]):
+                if c:
+                    print('%02X: %d' % (key + i, c))
+            key += n
+    else:
+        sys.exit('unknown command: %s' % cmd)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+#
+# Latency of host build(host/) from PS/2 byte injection to evdev key event
+#
+#   sudo uhid_latency.py [-n count] [host/_build/ps2host]
+#
+# Make and break of 'A' are written to stdin of ps2host and time to EV_KEY
+# on the virtual keyboard is measured with event timestamps(CLOCK_MONOTONIC).
+# USB polling is not emulated: this is converter core plus kernel input path.
+#
+import argparse
+import fcntl
+import glob
+import os
+import select
+import struct
+import subprocess
+import sys
+import time
+
+NAME = 'PS/2 Converter'
+EV_KEY = 1
+KEY_A = 30
+MAKE = b'\x1c'
+BREAK = b'\xf0\x1c'
+EVIOCSCLOCKID = 0x400445a0
+CLOCK_MONOTONIC = 1
+INPUT_EVENT = struct.Struct('llHHi')
+TIMEOUT = 1.0
+
+
+def find_events():
+    # keyboard interface is the one with KEY_A in its key capability bitmap
+    for path in glob.glob('/sys/class/input/event*'):
+        try:
+            name = open(path + '/device/name').read().strip()
+            caps = open(path + '/device/capabilities/key').read().split()
+        except OSError:
+            continue
+        if name != NAME:
+            continue
+        bits = int(caps[-1 - KEY_A // 64], 16) if len(caps) > KEY_A // 64 else 0
+        if bits & (1 << (KEY_A % 64)):
+            return '/dev/input/' + os.path.basename(path)
+    return None
+
+
+def wait_key(fd, value):
+    end = time.monotonic() + TIMEOUT
+    while time.monotonic() < end:
+        if not select.select([fd], [], [], TIMEOUT)[0]:
+            break
+        data = os.read(fd, INPUT_EVENT.size * 64)
+        for off in range(0, len(data), INPUT_EVENT.size):
+            sec, usec, type_, code, val = INPUT_EVENT.unpack_from(data, off)
+            if type_ == EV_KEY and code == KEY_A and val == value:
+                return sec * 1000000000 + usec * 1000
+    return None
+
+
+def stats(name, samples):
+    if not samples:
+        print('%s: no events' % name)
+        return
+    s = sorted(samples)
+    pct = lambda p: s[min(len(s) - 1, len(s) * p // 100)]
+    print('%-7s n:%d min:%.1f avg:%.1f p50:%.1f p99:%.1f max:%.1f us' % (
+        name, len(s), s[0] / 1000, sum(s) / len(s) / 1000, pct(50) / 1000, pct(99) / 1000, s[-1] / 1000))
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('-n', type=int, default=1000, help='number of key strokes')
+    ap.add_argument('-i', type=float, default=0.01, help='interval between events in seconds')
+    ap.add_argument('host', nargs='?', default=os.path.join(os.path.dirname(__file__), '../host/_build/ps2host'))
+    args = ap.parse_args()
+
+    proc = subprocess.Popen([args.host], stdin=subprocess.PIPE, stdout=subprocess.DEVNULL)
+    try:
+        dev = None
+        end = time.monotonic() + 5
+        while not dev and time.monotonic() < end:
+            time.sleep(0.1)
+            dev = find_events()
+        if not dev:
+            sys.exit('virtual keyboard not found')
+        fd = os.open(dev, os.O_RDONLY | os.O_NONBLOCK)
+        fcntl.ioctl(fd, EVIOCSCLOCKID, struct.pack('i', CLOCK_MONOTONIC))
+        time.sleep(0.5)     # keyboard detection
+
+        press, release = [], []
+        for _ in range(args.n):
+            for code, value, samples in ((MAKE, 1, press), (BREAK, 0, release)):
+                t = time.monotonic_ns()
+                proc.stdin.write(code)
+                proc.stdin.flush()
+                ev = wait_key(fd, value)
+                if ev is None:
+                    sys.exit('no event for %s' % code.hex())
+                samples.append(ev - t)
+                time.sleep(args.i)
+        stats('press', press)
+        stats('release', release)
+    finally:
+        proc.kill()
+
+
+if __name__ == '__main__':
+    main()
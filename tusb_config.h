@@ -91,14 +91,18 @@
 #endif
 
 //------------- CLASS -------------//
-#define CFG_TUD_HID               2
-#define CFG_TUD_CDC               1
+// interface selection and report layout in usb_descriptors.h
+#include "usb_descriptors.h"
+
+#define CFG_TUD_HID               (2 + RAW_ENABLE)
+#define CFG_TUD_CDC               CDC_ENABLE
 #define CFG_TUD_MSC               0
 #define CFG_TUD_MIDI              0
 #define CFG_TUD_VENDOR            0
 
 // HID buffer size Should be sufficient to hold ID (if any) + Data
-#define CFG_TUD_HID_EP_BUFSIZE    16
+// derived from report layout in usb_descriptors.h
+#define CFG_TUD_HID_EP_BUFSIZE    HID_EP_BUFSIZE
 
 // CDC
 #define CFG_TUD_CDC_RX_BUFSIZE  (256)
@@ -36,6 +36,19 @@
 #define USB_PID           (0x4000 | _PID_MAP(CDC, 0) | _PID_MAP(MSC, 1) | _PID_MAP(HID, 2) | \
                            _PID_MAP(MIDI, 3) | _PID_MAP(VENDOR, 4) )
 
+// Report layout checks: sizes are derived in usb_descriptors.h, and these
+// catch configurations that would be truncated silently by TinyUSB.
+// Boot and NKRO reports are told apart by length(keyboard_report_has())
+_Static_assert(KEYBOARD_REPORT_SIZE > KEYBOARD_BOOT_SIZE, "NKRO report is not longer than boot report");
+// Report Count of NKRO bitmap is a 2-byte item: 256 bits of usages 0-255 fit
+_Static_assert(KEYBOARD_REPORT_BITS * 8 <= 256, "NKRO bitmap exceeds keyboard usages 0-255");
+_Static_assert(KEYBOARD_EP_SIZE <= 64 && HID_EP_SIZE <= 64 && RAW_EP_SIZE <= 64, "Full speed interrupt endpoint is 64 bytes at most");
+_Static_assert(CFG_TUD_HID_EP_BUFSIZE >= KEYBOARD_EP_SIZE, "HID buffer is smaller than keyboard report");
+_Static_assert(CFG_TUD_HID_EP_BUFSIZE >= HID_EP_SIZE, "HID buffer is smaller than mouse/usage report");
+_Static_assert(CFG_TUD_HID_EP_BUFSIZE >= RAW_EP_SIZE, "HID buffer is smaller than raw report");
+_Static_assert(MOUSE_REPORT_SIZE == sizeof(hid_mouse_report_t), "Mouse report size mismatch");
+_Static_assert(USAGE_REPORT_COUNT >= 1 && USAGE_REPORT_COUNT <= 16, "Usage report count out of range");
+
 #define USB_VID   0x7E57
 #define USB_BCD   0x0200
 
@@ -107,7 +120,7 @@ uint8_t const desc_hid_keyboard_report[] =
       HID_USAGE_MAX    ( (KEYBOARD_REPORT_BITS * 8 - 1)         )  ,
       HID_LOGICAL_MIN  ( 0                                      )  ,
       HID_LOGICAL_MAX  ( 1                                      )  ,
-      HID_REPORT_COUNT ( (KEYBOARD_REPORT_BITS * 8)             )  ,
+      HID_REPORT_COUNT_N ( (KEYBOARD_REPORT_BITS * 8), 2        )  ,
       HID_REPORT_SIZE  ( 1                                      )  ,
       HID_INPUT        ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE )  ,
   HID_COLLECTION_END
@@ -116,17 +129,70 @@ uint8_t const desc_hid_keyboard_report[] =
 uint8_t const desc_hid_report[] =
 {
   TUD_HID_REPORT_DESC_MOUSE         ( HID_REPORT_ID( REPORT_ID_MOUSE            )),
-  TUD_HID_REPORT_DESC_CONSUMER      ( HID_REPORT_ID( REPORT_ID_CONSUMER_CONTROL )),
-  TUD_HID_REPORT_DESC_SYSTEM_CONTROL( HID_REPORT_ID( REPORT_ID_SYSTEM_CONTROL   ))
+
+  // Consumer Control: array of usages pressed at the same time
+  HID_USAGE_PAGE ( HID_USAGE_PAGE_CONSUMER    )                    ,
+  HID_USAGE      ( HID_USAGE_CONSUMER_CONTROL )                    ,
+  HID_COLLECTION ( HID_COLLECTION_APPLICATION )                    ,
+    HID_REPORT_ID    ( REPORT_ID_CONSUMER_CONTROL               )
+    HID_USAGE_MIN    ( 0x00                                     )  ,
+    HID_USAGE_MAX_N  ( 0x3FF, 2                                 )  ,
+    HID_LOGICAL_MIN  ( 0x00                                     )  ,
+    HID_LOGICAL_MAX_N( 0x3FF, 2                                 )  ,
+    HID_REPORT_COUNT ( USAGE_REPORT_COUNT                       )  ,
+    HID_REPORT_SIZE  ( 16                                       )  ,
+    HID_INPUT        ( HID_DATA | HID_ARRAY | HID_ABSOLUTE      )  ,
+  HID_COLLECTION_END                                               ,
+
+  // System Control: array of Power Down, Sleep and Wake Up
+  HID_USAGE_PAGE ( HID_USAGE_PAGE_DESKTOP           )              ,
+  HID_USAGE      ( HID_USAGE_DESKTOP_SYSTEM_CONTROL )              ,
+  HID_COLLECTION ( HID_COLLECTION_APPLICATION       )              ,
+    HID_REPORT_ID    ( REPORT_ID_SYSTEM_CONTROL                 )
+    HID_USAGE_MIN    ( HID_USAGE_DESKTOP_SYSTEM_POWER_DOWN      )  ,
+    HID_USAGE_MAX    ( HID_USAGE_DESKTOP_SYSTEM_WAKE_UP         )  ,
+    HID_LOGICAL_MIN_N( HID_USAGE_DESKTOP_SYSTEM_POWER_DOWN, 2   )  ,
+    HID_LOGICAL_MAX_N( HID_USAGE_DESKTOP_SYSTEM_WAKE_UP, 2      )  ,
+    HID_REPORT_COUNT ( USAGE_REPORT_COUNT                       )  ,
+    HID_REPORT_SIZE  ( 16                                       )  ,
+    HID_INPUT        ( HID_DATA | HID_ARRAY | HID_ABSOLUTE      )  ,
+  HID_COLLECTION_END
 };
 
 // Invoked when received GET HID REPORT DESCRIPTOR
 // Application return pointer to descriptor
 // Descriptor contents must exist long enough for transfer to complete
+#if RAW_ENABLE
+// Raw HID: vendor-defined 64-byte input and output, TUD_HID_REPORT_DESC_GENERIC_INOUT
+// with feature report for latency probe
+uint8_t const desc_hid_raw_report[] =
+{
+  HID_USAGE_PAGE_N ( HID_USAGE_PAGE_VENDOR, 2                  )  ,
+  HID_USAGE        ( 0x01                                      )  ,
+  HID_COLLECTION   ( HID_COLLECTION_APPLICATION                )  ,
+    HID_USAGE        ( 0x02                                    )  ,
+    HID_LOGICAL_MIN  ( 0x00                                    )  ,
+    HID_LOGICAL_MAX_N( 0xFF, 2                                 )  ,
+    HID_REPORT_SIZE  ( 8                                       )  ,
+    HID_REPORT_COUNT ( RAW_REPORT_SIZE                         )  ,
+    HID_INPUT        ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE  )  ,
+    HID_USAGE        ( 0x03                                    )  ,
+    HID_REPORT_COUNT ( RAW_REPORT_SIZE                         )  ,
+    HID_OUTPUT       ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE  )  ,
+    HID_USAGE        ( 0x04                                    )  ,
+    HID_REPORT_COUNT ( RAW_PROBE_SIZE                          )  ,
+    HID_FEATURE      ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE  )  ,
+  HID_COLLECTION_END
+};
+#endif
+
 uint8_t const * tud_hid_descriptor_report_cb(uint8_t instance)
 {
-  if (instance == 0) return desc_hid_keyboard_report;
-  if (instance == 1) return desc_hid_report;
+  if (instance == ITF_NUM_KEYBOARD) return desc_hid_keyboard_report;
+  if (instance == ITF_NUM_HID) return desc_hid_report;
+#if RAW_ENABLE
+  if (instance == ITF_NUM_RAW) return desc_hid_raw_report;
+#endif
   return NULL;
 }
 
@@ -134,13 +200,8 @@ uint8_t const * tud_hid_descriptor_report_cb(uint8_t instance)
 // Configuration Descriptor
 //--------------------------------------------------------------------+
 
-#define EPNUM_KEYBOARD      0x81
-#define EPNUM_HID           0x82
-#define EPNUM_CDC_CONTROL   0x83
-#define EPNUM_CDC_DATA_OUT  0x04
-#define EPNUM_CDC_DATA_IN   0x84
-
-#define  CONFIG_TOTAL_LEN  (TUD_CONFIG_DESC_LEN + TUD_HID_DESC_LEN + TUD_HID_DESC_LEN + TUD_CDC_DESC_LEN)
+#define  CONFIG_TOTAL_LEN  (TUD_CONFIG_DESC_LEN + TUD_HID_DESC_LEN + TUD_HID_DESC_LEN + \
+                            RAW_ENABLE * TUD_HID_INOUT_DESC_LEN + CDC_ENABLE * TUD_CDC_DESC_LEN)
 
 uint8_t const desc_configuration[] =
 {
@@ -148,12 +209,19 @@ uint8_t const desc_configuration[] =
   TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 100),
 
   // Interface number, string index, protocol, report descriptor len, EP In address, size & polling interval
-  TUD_HID_DESCRIPTOR(ITF_NUM_KEYBOARD, 0, HID_ITF_PROTOCOL_KEYBOARD, sizeof(desc_hid_keyboard_report), EPNUM_KEYBOARD, KEYBOARD_REPORT_SIZE, 1),
+  TUD_HID_DESCRIPTOR(ITF_NUM_KEYBOARD, 0, HID_ITF_PROTOCOL_KEYBOARD, sizeof(desc_hid_keyboard_report), EPNUM_KEYBOARD, KEYBOARD_EP_SIZE, 1),
+
+  TUD_HID_DESCRIPTOR(ITF_NUM_HID, 0, HID_ITF_PROTOCOL_NONE, sizeof(desc_hid_report), EPNUM_HID, HID_EP_SIZE, 5),
 
-  TUD_HID_DESCRIPTOR(ITF_NUM_HID, 0, HID_ITF_PROTOCOL_NONE, sizeof(desc_hid_report), EPNUM_HID, CFG_TUD_HID_EP_BUFSIZE, 5),
+#if RAW_ENABLE
+  // Interface number, string index, protocol, report descriptor len, EP Out & In address, size & polling interval
+  TUD_HID_INOUT_DESCRIPTOR(ITF_NUM_RAW, 0, HID_ITF_PROTOCOL_NONE, sizeof(desc_hid_raw_report), EPNUM_RAW_OUT, EPNUM_RAW_IN, RAW_EP_SIZE, 10),
+#endif
 
+#if CDC_ENABLE
   //interface_no, str_idx, ep_notification, ep_notification_size, ep_out, ep_in, epsize)
-  TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, 0, EPNUM_CDC_CONTROL, 8, EPNUM_CDC_DATA_OUT, EPNUM_CDC_DATA_IN, 64)
+  TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, 0, EPNUM_CDC_CONTROL, 8, EPNUM_CDC_DATA_OUT, EPNUM_CDC_DATA_IN, 64),
+#endif
 };
 
 // Invoked when received GET CONFIGURATION DESCRIPTOR
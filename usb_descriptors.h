@@ -25,16 +25,41 @@
 #ifndef USB_DESCRIPTORS_H_
 #define USB_DESCRIPTORS_H_
 
+// Optional interfaces
+// RAW_ENABLE: vendor-defined HID for telemetry and configuration(raw.c)
+// CDC_ENABLE: debug console with stdio, production build can drop it
+#ifndef RAW_ENABLE
+#define RAW_ENABLE  1
+#endif
+#ifndef CDC_ENABLE
+#define CDC_ENABLE  1
+#endif
+
 // Interfaces
+// HID interfaces come first so that interface number is also HID instance number
 enum
 {
   ITF_NUM_KEYBOARD,
   ITF_NUM_HID,
+#if RAW_ENABLE
+  ITF_NUM_RAW,
+#endif
+#if CDC_ENABLE
   ITF_NUM_CDC,
   ITF_NUM_CDC_DATA, // CDC needs 2 interfaces
+#endif
   ITF_NUM_TOTAL
 };
 
+// Endpoints
+#define EPNUM_KEYBOARD      0x81
+#define EPNUM_HID           0x82
+#define EPNUM_CDC_CONTROL   0x83
+#define EPNUM_CDC_DATA_OUT  0x04
+#define EPNUM_CDC_DATA_IN   0x84
+#define EPNUM_RAW_OUT       0x05
+#define EPNUM_RAW_IN        0x85
+
 enum
 {
   REPORT_ID_MOUSE = 1,
@@ -43,9 +68,52 @@ enum
   REPORT_ID_COUNT
 };
 
-// 20-byte NKRO: support keycodes upto LANG8(0x97)
-#define KEYBOARD_REPORT_SIZE    20
+//--------------------------------------------------------------------+
+// Report layout configuration
+//
+// Report descriptors, endpoint sizes and HID buffer size in tusb_config.h
+// are derived from these and checked in usb_descriptors.c.
+//--------------------------------------------------------------------+
+
+// NKRO bitmap covers keyboard usages 0 to KEYBOARD_NKRO_USAGE_MAX
+// default 0x97(LANG8): 20-byte report, 0x38 at least: longer than boot report
+#ifndef KEYBOARD_NKRO_USAGE_MAX
+#define KEYBOARD_NKRO_USAGE_MAX 0x97
+#endif
+#define KEYBOARD_REPORT_BITS    ((KEYBOARD_NKRO_USAGE_MAX + 8) / 8)
+#define KEYBOARD_REPORT_SIZE    (1 + KEYBOARD_REPORT_BITS)
 #define KEYBOARD_REPORT_KEYS    (KEYBOARD_REPORT_SIZE - 2)
-#define KEYBOARD_REPORT_BITS    (KEYBOARD_REPORT_SIZE - 1)
+
+// Boot protocol fallback: mods, reserved and 6 keys at head of the same buffer
+#define KEYBOARD_BOOT_KEYS      6
+#define KEYBOARD_BOOT_SIZE      (2 + KEYBOARD_BOOT_KEYS)
+
+// Consumer/System Control: number of usages reported at the same time
+#ifndef USAGE_REPORT_COUNT
+#define USAGE_REPORT_COUNT      4
+#endif
+#define USAGE_REPORT_SIZE       (USAGE_REPORT_COUNT * 2)
+
+// hid_mouse_report_t: buttons, x, y, wheel, pan
+#define MOUSE_REPORT_SIZE       5
+
+// Raw HID: fixed size without report ID
+#define RAW_REPORT_SIZE         64
+// Raw HID feature report for latency probe on control pipe
+#define RAW_PROBE_SIZE          8
+
+#define REPORT_SIZE_MAX(a, b)   ((a) > (b) ? (a) : (b))
+
+// Endpoint sizes: HID interface reports are prefixed with report ID
+#define KEYBOARD_EP_SIZE        KEYBOARD_REPORT_SIZE
+#define HID_EP_SIZE             (1 + REPORT_SIZE_MAX(MOUSE_REPORT_SIZE, USAGE_REPORT_SIZE))
+#if RAW_ENABLE
+#define RAW_EP_SIZE             RAW_REPORT_SIZE
+#else
+#define RAW_EP_SIZE             0
+#endif
+
+// TinyUSB uses one buffer size for all HID interfaces
+#define HID_EP_BUFSIZE          REPORT_SIZE_MAX(REPORT_SIZE_MAX(KEYBOARD_EP_SIZE, HID_EP_SIZE), RAW_EP_SIZE)
 
 #endif /* USB_DESCRIPTORS_H_ */